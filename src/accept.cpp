@@ -0,0 +1,165 @@
+#include "accept.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// What became of one input
+enum accept_outcome
+{
+    OUTCOME_ACCEPT,
+    OUTCOME_REJECT,
+    OUTCOME_HALT,
+    OUTCOME_TIMEOUT,
+    OUTCOME_INVALID
+};
+
+static const char *outcome_names[] = {"accept", "reject", "halt", "timeout", "invalid"};
+
+struct accept_result
+{
+    accept_outcome outcome;
+    long long ticks;
+};
+
+// Put the machine back at the start of a run (see tm_engine::reset()) with an input
+// written on the tape from the tape head rightwards. Returns false if the input has
+// a character that isn't a symbol.
+bool loadInput(tm_engine &machine, const std::string &input)
+{
+    machine.reset();
+
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        int y = -1;
+        for (int k = 0; k < NUMSYM; ++k)
+            if (symbol_char[k] == input[i])
+                y = k;
+        if (y < 0)
+            return false;
+        // (the tape is blank already)
+        if (y != BLANK)
+            machine.getTape().setTapeCell((symbol)y, (long long)i);
+    }
+
+    return true;
+}
+
+// Read a line of any length, without its line ending. Returns false at the end of the file.
+static bool readLine(FILE *in, std::string &line)
+{
+    char part[4096];
+    line.clear();
+
+    while (fgets(part, sizeof(part), in) != NULL)
+    {
+        line += part;
+        if (line[line.size() - 1] == '\n')
+            break;
+    }
+    if (line.empty() && feof(in))
+        return false;
+
+    while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+        line.erase(line.size() - 1);
+    return true;
+}
+
+// Worker thread: run inputs of the chunk (taking the next one not yet taken) until
+// none are left
+static void acceptWorker(tm_engine machine, const std::vector<std::string> &inputs, size_t count,
+                         std::atomic<size_t> &next, long long max_steps, std::vector<accept_result> &results)
+{
+    for (size_t i = next++; i < count; i = next++)
+    {
+        accept_result &r = results[i];
+        r.ticks = 0;
+        if (!loadInput(machine, inputs[i]))
+        {
+            r.outcome = OUTCOME_INVALID;
+            continue;
+        }
+
+        // inputs are mostly short, so run() is used: runSized() takes longer to set up
+        // than such a run takes
+        run_result result = machine.run(max_steps);
+
+        r.ticks = result.ticks;
+        if (!result.halted)
+            r.outcome = OUTCOME_TIMEOUT;
+        else if (result.final_state == STATE_QACCEPT)
+            r.outcome = OUTCOME_ACCEPT;
+        else if (result.final_state == STATE_QREJECT)
+            r.outcome = OUTCOME_REJECT;
+        else
+            r.outcome = OUTCOME_HALT;
+    }
+}
+
+// Run the machine on every input (line) of in, on threads worker threads (0 for one
+// per core), writing a result line per input to out in input order. The machine's
+// rule-set and tape format are used; its tape is left as it was. Returns the totals.
+accept_totals runAcceptance(tm_engine &machine, FILE *in, FILE *out, long long max_steps, int threads)
+{
+    int num_threads = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    if (num_threads < 1)
+        num_threads = 1;
+
+    accept_totals totals;
+    totals.inputs = totals.accepted = totals.rejected = totals.halted = 0;
+    totals.timeouts = totals.invalid = totals.ticks = 0;
+
+    // (a copy, so that every worker starts from the same machine)
+    tm_engine start = machine;
+    std::vector<std::string> inputs(ACCEPTCHUNK);
+    std::vector<accept_result> results(ACCEPTCHUNK);
+    std::string buffer;
+    bool more = true;
+
+    while (more)
+    {
+        size_t count = 0;
+        while (count < inputs.size() && (more = readLine(in, inputs[count])))
+            count++;
+        if (count == 0)
+            break;
+
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < num_threads && (size_t)i < count; ++i)
+            workers.push_back(std::thread(acceptWorker, start, std::cref(inputs), count, std::ref(next),
+                                          max_steps, std::ref(results)));
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const accept_result &r = results[i];
+            char line[64];
+            if (r.outcome == OUTCOME_INVALID)
+                snprintf(line, sizeof(line), "%s ", outcome_names[r.outcome]);
+            else
+                snprintf(line, sizeof(line), "%s %lld ", outcome_names[r.outcome], r.ticks);
+            buffer += line;
+            buffer += inputs[i];
+            buffer += '\n';
+
+            totals.inputs++;
+            totals.ticks += r.ticks;
+            if (r.outcome == OUTCOME_ACCEPT)
+                totals.accepted++;
+            else if (r.outcome == OUTCOME_REJECT)
+                totals.rejected++;
+            else if (r.outcome == OUTCOME_HALT)
+                totals.halted++;
+            else if (r.outcome == OUTCOME_TIMEOUT)
+                totals.timeouts++;
+            else
+                totals.invalid++;
+        }
+
+        fwrite(buffer.data(), 1, buffer.size(), out);
+        buffer.clear();
+    }
+
+    return totals;
+}
@@ -0,0 +1,40 @@
+#ifndef ACCEPT_H
+#define ACCEPT_H
+
+// Batch acceptance testing: a machine used as a recognizer over a file of inputs, one
+// per line. Each input is written onto a fresh tape from the tape head (cell 0)
+// rightwards, a symbol per character (. X $ & 0 1, as the tape displays them), and the
+// machine is run from state a for at most the step limit. Lines are read ACCEPTCHUNK
+// at a time and shared out between worker threads, each running its own copy of the
+// machine, and the results of a chunk are written in input order before the next chunk
+// is read, a line per input:
+//   accept <ticks> <input>    the machine reached STATE_QACCEPT after <ticks> ticks
+//   reject <ticks> <input>    ... STATE_QREJECT
+//   halt <ticks> <input>      ... STATE_QHALT
+//   timeout <ticks> <input>   it was still running at the step limit
+//   invalid <input>           the line holds a character that isn't a symbol (not run)
+
+#include "engine.h"
+#include <stdio.h>
+#include <string>
+
+// Inputs read (and run) at a time
+#define ACCEPTCHUNK 16384
+
+// Totals of an acceptance run
+struct accept_totals
+{
+    long long inputs;
+    long long accepted;
+    long long rejected;
+    long long halted;
+    long long timeouts;
+    long long invalid;
+    // ticks taken by every input together
+    long long ticks;
+};
+
+bool loadInput(tm_engine &,const std::string &);
+accept_totals runAcceptance(tm_engine &,FILE *,FILE *,long long,int);
+
+#endif
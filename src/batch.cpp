@@ -0,0 +1,583 @@
+#include "batch.h"
+#include <algorithm>
+#include <string.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// A packed rule: where the next state's rules start (state * NUMSYM), or the halting
+// state itself, the symbol to write, the direction and whether it halts
+#define BATCH_NEXT   0x000FF
+#define BATCH_WRITE  0x0FF00
+#define BATCH_WRITE_SHIFT 8
+#define BATCH_RIGHT  0x10000
+#define BATCH_HALTS  0x20000
+
+// Bytes from the start of one lane's tape window to the next
+#define BATCHSTRIDE (BATCHTAPE + 4)
+
+batch_engine::batch_engine(long long steps)
+{
+    max_steps = steps;
+    input = NULL;
+    iteration = started = handed_over = 0;
+    programs.assign(BATCHLANES * NUMSTT * NUMSYM, 0);
+    tapes.assign(BATCHLANES * BATCHSTRIDE, BLANK);
+    for (int i = 0; i < BATCHLANES; ++i)
+    {
+        lane_busy[i] = 0;
+        lane_current[i] = 0;
+        lane_position[i] = lane_min[i] = lane_max[i] = BATCHTAPE / 2;
+        lane_read[i] = lane_rule[i] = lane_count[i] = 0;
+    }
+}
+
+// Run every machine the input gives to the end (halting, or max_steps ticks), passing
+// each result back to the input. Returns the number of machines run.
+long long batch_engine::run(batch_input &in)
+{
+    input = &in;
+    started = handed_over = 0;
+
+    for (int i = 0; i < BATCHLANES; ++i)
+        fill(i);
+
+    for (;;)
+    {
+        // run until the first lane reaches the step limit (or sooner, if a lane halts
+        // or leaves its window)
+        long long steps = -1;
+        for (int i = 0; i < BATCHLANES; ++i)
+        {
+            if (lane_busy[i] && (steps < 0 || lane_start[i] + max_steps - iteration < steps))
+                steps = lane_start[i] + max_steps - iteration;
+        }
+        if (steps < 0)
+            break;
+
+        iteration += advance(steps);
+
+        for (int i = 0; i < BATCHLANES; ++i)
+        {
+            if (!lane_busy[i])
+                continue;
+            bool halted = (lane_rule[i] & BATCH_HALTS) != 0;
+            bool outside = (lane_position[i] & ~(BATCHTAPE - 1)) != 0;
+            if (halted || outside || iteration - lane_start[i] == max_steps)
+            {
+                finish(i);
+                fill(i);
+            }
+        }
+    }
+
+    input = NULL;
+    return started;
+}
+
+// Number of machines (in the last run) that left their tape window and were
+// finished by tm_engine::run()
+long long batch_engine::getHandedOver()
+{
+    return handed_over;
+}
+
+// Put the next machine from the input in a lane (or leave the lane empty)
+void batch_engine::fill(int lane)
+{
+    tm_engine &machine = machines[lane];
+    machine.reset();
+
+    // an empty lane still has its tape head read (and ignored) every step, so it
+    // is put back in the middle of its window
+    lane_current[lane] = 0;
+    lane_position[lane] = lane_min[lane] = lane_max[lane] = BATCHTAPE / 2;
+    lane_rule[lane] = 0;
+    lane_count[lane] = 0;
+
+    while (true)
+    {
+        if (!input->next(machine))
+        {
+            lane_busy[lane] = 0;
+            return;
+        }
+        if (max_steps > 0)
+            break;
+        // nothing to step
+        input->finished(started++, machine, machine.getResult());
+    }
+
+    int *program = &programs[lane * NUMSTT * NUMSYM];
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            const transition &rule = machine.getRule(i, j);
+            int packed = (int)rule.write_symbol << BATCH_WRITE_SHIFT;
+            if (isHaltingState(rule.next_state))
+                packed |= BATCH_HALTS | (int)rule.next_state;
+            else
+                packed |= (int)rule.next_state * NUMSYM;
+            if (rule.move_head == RIGHT)
+                packed |= BATCH_RIGHT;
+            program[i * NUMSYM + j] = packed;
+        }
+    }
+
+    lane_busy[lane] = -1;
+    lane_index[lane] = started++;
+    lane_start[lane] = iteration;
+}
+
+// Pass on the result of a lane's machine, once it has halted, reached the step limit
+// or left its window, and clear its tape window for the next one
+void batch_engine::finish(int lane)
+{
+    tm_engine &machine = machines[lane];
+    unsigned char *window = &tapes[lane * BATCHSTRIDE];
+    int lo = lane_min[lane];
+    int hi = lane_max[lane];
+    run_result result;
+
+    if (lane_rule[lane] & BATCH_HALTS)
+    {
+        // the halting rule was read in the last step, which doesn't count as a tick
+        result.ticks = iteration - 1 - lane_start[lane];
+        result.final_state = (state)(lane_rule[lane] & BATCH_NEXT);
+        result.halted = true;
+        result.halt_rule_state = (state)(lane_current[lane] / NUMSYM);
+        result.halt_rule_symbol = (symbol)lane_read[lane];
+        result.tape_min = lo - BATCHTAPE / 2;
+        result.tape_max = hi - BATCHTAPE / 2;
+        result.non_blank = lane_count[lane];
+    }
+    else if (iteration - lane_start[lane] == max_steps)
+    {
+        result.ticks = max_steps;
+        result.final_state = (state)(lane_current[lane] / NUMSYM);
+        result.halted = false;
+        result.halt_rule_state = STATE_QA;
+        result.halt_rule_symbol = BLANK;
+        result.tape_min = lo - BATCHTAPE / 2;
+        result.tape_max = hi - BATCHTAPE / 2;
+        result.non_blank = lane_count[lane];
+    }
+    else
+    {
+        // off the end of the window: carry on in the machine itself
+        // (the last cell moved onto is outside the window, and blank)
+        for (int p = std::max(lo, 0); p <= std::min(hi, BATCHTAPE - 1); ++p)
+        {
+            if (window[p] != BLANK)
+                machine.getTape().setTapeCell((symbol)window[p], p - BATCHTAPE / 2);
+        }
+        long long ticks = iteration - lane_start[lane];
+        machine.getTapeHead().setTapeHeadLoc(lane_position[lane] - BATCHTAPE / 2);
+        machine.getTapeHead().setCurrentState((state)(lane_current[lane] / NUMSYM));
+        machine.setTicks(ticks);
+        machine.setSpan(lo - BATCHTAPE / 2, hi - BATCHTAPE / 2);
+        result = machine.run(max_steps - ticks);
+        handed_over++;
+    }
+
+    input->finished(lane_index[lane], machine, result);
+
+    // only the cells the tape head has been over can have been written
+    lo = std::max(lo, 0);
+    hi = std::min(hi, BATCHTAPE - 1);
+    memset(window + lo, BLANK, hi - lo + 1);
+}
+
+// A batch of count random rule-sets, with results written to out (or nowhere, if out
+// is NULL)
+triage_batch::triage_batch(long long count, FILE *out)
+{
+    remaining = count;
+    library = NULL;
+    library_index = 0;
+    seen = NULL;
+    rule_states = NUMSTT;
+    rule_symbols = NUMSYM;
+    seeded = false;
+    seed = 0;
+    seed_index = 0;
+    output = out;
+    clearTotals(totals);
+}
+
+triage_batch::~triage_batch()
+{
+    flushOutput();
+}
+
+// Take machines from a library instead, starting at machine first
+void triage_batch::setLibrary(machine_library *machines, long long first)
+{
+    library = machines;
+    library_index = first;
+}
+
+// Pass over machines that are the same as one already run (see canonicalize()).
+// They count towards the number of machines asked for, but aren't run.
+void triage_batch::setDedup(dedup_set *set)
+{
+    seen = set;
+}
+
+// Make the random rule-sets this many states and symbols (see setupTransitionTable())
+void triage_batch::setSize(int states, int symbols)
+{
+    rule_states = states;
+    rule_symbols = symbols;
+}
+
+// Make random rule-set i out of the seed alone (see seededRuleset()), from i = first
+// on, rather than from rand(): any stretch of a seeded random search then gives the
+// same machines whichever process runs it
+void triage_batch::setSeed(unsigned long long s, long long first)
+{
+    seeded = true;
+    seed = s;
+    seed_index = first;
+}
+
+bool triage_batch::next(tm_engine &machine)
+{
+    canonical_form form;
+
+    while (remaining > 0)
+    {
+        remaining--;
+
+        if (library == NULL && seeded)
+        {
+            seededRuleset(machine, seed, seed_index++, rule_states, rule_symbols);
+        }
+        else if (library == NULL)
+        {
+            machine.setupTransitionTable(true, rule_states, rule_symbols);
+        }
+        else
+        {
+            // (damaged machines are passed over)
+            while (library_index < library->getCount() && !library->load(library_index, machine))
+                library_index++;
+            if (library_index++ >= library->getCount())
+                return false;
+        }
+
+        if (seen != NULL)
+        {
+            canonicalize(machine, form);
+            if (!seen->insert(form))
+            {
+                totals.duplicates++;
+                continue;
+            }
+        }
+
+        // a machine that can never halt doesn't need the whole step limit to show it
+        if (backward.decide(machine).kind == VERDICT_UNREACHABLE)
+        {
+            totals.machines++;
+            totals.looping++;
+            addLine("unreachable ", machine);
+            continue;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void triage_batch::finished(long long, tm_engine &machine, const run_result &result)
+{
+    int states, symbols;
+    usedSize(machine, states, symbols);
+    totals.machines++;
+
+    if (result.halted)
+    {
+        char line[64];
+        std::string rules = machine.rulesetString(states, symbols);
+        snprintf(line, sizeof(line), "halt %lld ", result.ticks);
+        buffer += line;
+        buffer += rules;
+        totals.halted++;
+        if (result.ticks > totals.champion_ticks)
+        {
+            totals.champion_ticks = result.ticks;
+            totals.champion_rules = rules;
+        }
+    }
+    else
+    {
+        buffer += "undecided ";
+        buffer += machine.rulesetString(states, symbols);
+        totals.undecided++;
+    }
+    buffer += '\n';
+
+    if (buffer.size() >= 65536)
+        flushOutput();
+}
+
+// Add a result line with no numbers in it: what, then the machine's rule-set
+void triage_batch::addLine(const char *what, tm_engine &machine)
+{
+    int states, symbols;
+    usedSize(machine, states, symbols);
+    buffer += what;
+    buffer += machine.rulesetString(states, symbols);
+    buffer += '\n';
+
+    if (buffer.size() >= 65536)
+        flushOutput();
+}
+
+// Totals of the machines finished so far
+search_totals triage_batch::getTotals()
+{
+    return totals;
+}
+
+void triage_batch::flushOutput()
+{
+    if (output != NULL)
+        fwrite(buffer.data(), 1, buffer.size(), output);
+    buffer.clear();
+}
+
+#if defined(__AVX512F__)
+
+// Step every busy lane up to steps times, stopping early after a step in which a lane
+// halts or moves off its window. Returns the number of steps taken.
+long long batch_engine::advance(long long steps)
+{
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i tape_base = _mm512_mullo_epi32(lanes, _mm512_set1_epi32(BATCHSTRIDE));
+    const __m512i program_base = _mm512_mullo_epi32(lanes, _mm512_set1_epi32(NUMSTT * NUMSYM));
+    const __m512i low_byte = _mm512_set1_epi32(0xFF);
+    const __m512i halts_bit = _mm512_set1_epi32(BATCH_HALTS);
+    const __m512i right_bit = _mm512_set1_epi32(BATCH_RIGHT);
+    const __m512i outside_bits = _mm512_set1_epi32(~(BATCHTAPE - 1));
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i minus_one = _mm512_set1_epi32(-1);
+    const __m512i zero = _mm512_setzero_si512();
+    const int *tape_words = (const int *)&tapes[0];
+    const int *program = &programs[0];
+    unsigned char *cells = &tapes[0];
+
+    __mmask16 busy = _mm512_cmpneq_epi32_mask(_mm512_loadu_si512(lane_busy), _mm512_setzero_si512());
+    __m512i current = _mm512_loadu_si512(lane_current);
+    __m512i position = _mm512_loadu_si512(lane_position);
+    __m512i lo = _mm512_loadu_si512(lane_min);
+    __m512i hi = _mm512_loadu_si512(lane_max);
+    __m512i count = _mm512_loadu_si512(lane_count);
+    __m512i read = zero;
+    __m512i rule = zero;
+    alignas(64) int address[BATCHLANES];
+    alignas(64) int write[BATCHLANES];
+    long long n = 0;
+
+    while (n < steps)
+    {
+        // the cell under every tape head, and the rule it selects
+        __m512i cell = _mm512_add_epi32(tape_base, position);
+        read = _mm512_and_si512(_mm512_mask_i32gather_epi32(zero, busy, cell, tape_words, 1), low_byte);
+        rule = _mm512_mask_i32gather_epi32(zero, busy, _mm512_add_epi32(program_base, _mm512_add_epi32(current, read)), program, 4);
+
+        // lanes that step (busy, and not halting)
+        __mmask16 halts = _mm512_mask_test_epi32_mask(busy, rule, halts_bit);
+        __mmask16 moving = busy & ~halts;
+
+        // the cells are bytes, too small to scatter, so they are written one lane at a time
+        __m512i written = _mm512_and_si512(_mm512_maskz_srli_epi32(moving, rule, BATCH_WRITE_SHIFT), low_byte);
+        _mm512_store_si512(address, cell);
+        _mm512_store_si512(write, written);
+        for (int i = 0; i < BATCHLANES; ++i)
+        {
+            if (moving & (1 << i))
+                cells[address[i]] = (unsigned char)write[i];
+        }
+
+        __m512i move = _mm512_mask_blend_epi32(_mm512_test_epi32_mask(rule, right_bit), minus_one, one);
+        position = _mm512_mask_add_epi32(position, moving, position, move);
+        current = _mm512_mask_and_epi32(current, moving, rule, low_byte);
+        lo = _mm512_mask_min_epi32(lo, moving, lo, position);
+        hi = _mm512_mask_max_epi32(hi, moving, hi, position);
+        // a blank cell made non-blank counts one more, and the other way round one less
+        count = _mm512_mask_add_epi32(count, moving & _mm512_cmpeq_epi32_mask(read, zero), count, one);
+        count = _mm512_mask_sub_epi32(count, moving & _mm512_cmpeq_epi32_mask(written, zero), count, one);
+        n++;
+
+        __mmask16 outside = _mm512_mask_test_epi32_mask(moving, position, outside_bits);
+        if (halts | outside)
+            break;
+    }
+
+    _mm512_storeu_si512(lane_current, current);
+    _mm512_storeu_si512(lane_position, position);
+    _mm512_storeu_si512(lane_min, lo);
+    _mm512_storeu_si512(lane_max, hi);
+    _mm512_storeu_si512(lane_count, count);
+    _mm512_storeu_si512(lane_read, read);
+    _mm512_storeu_si512(lane_rule, rule);
+
+    return n;
+}
+
+#elif defined(__AVX2__)
+
+// Step every busy lane up to steps times, stopping early after a step in which a lane
+// halts or moves off its window. Returns the number of steps taken.
+long long batch_engine::advance(long long steps)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    static_assert(BATCHLANES == 8, "the AVX2 batch engine steps 8 lanes");
+    const __m256i tape_base = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(BATCHSTRIDE));
+    const __m256i program_base = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(NUMSTT * NUMSYM));
+    const __m256i low_byte = _mm256_set1_epi32(0xFF);
+    const __m256i halts_bit = _mm256_set1_epi32(BATCH_HALTS);
+    const __m256i outside_bits = _mm256_set1_epi32(~(BATCHTAPE - 1));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const int *tape_words = (const int *)&tapes[0];
+    const int *program = &programs[0];
+    unsigned char *cells = &tapes[0];
+
+    __m256i busy = _mm256_loadu_si256((const __m256i *)lane_busy);
+    __m256i current = _mm256_loadu_si256((const __m256i *)lane_current);
+    __m256i position = _mm256_loadu_si256((const __m256i *)lane_position);
+    __m256i lo = _mm256_loadu_si256((const __m256i *)lane_min);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)lane_max);
+    __m256i count = _mm256_loadu_si256((const __m256i *)lane_count);
+    __m256i read = zero;
+    __m256i rule = zero;
+    alignas(32) int address[BATCHLANES];
+    alignas(32) int write[BATCHLANES];
+    long long n = 0;
+
+    while (n < steps)
+    {
+        // the cell under every tape head, and the rule it selects
+        __m256i cell = _mm256_add_epi32(tape_base, position);
+        read = _mm256_and_si256(_mm256_i32gather_epi32(tape_words, cell, 1), low_byte);
+        rule = _mm256_i32gather_epi32(program, _mm256_add_epi32(program_base, _mm256_add_epi32(current, read)), 4);
+
+        // lanes that step (busy, and not halting)
+        __m256i halts = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(rule, halts_bit), halts_bit), busy);
+        __m256i moving = _mm256_andnot_si256(halts, busy);
+        int moving_lanes = _mm256_movemask_ps(_mm256_castsi256_ps(moving));
+
+        // AVX2 has no scatter, so the cells are written one lane at a time
+        __m256i written = _mm256_and_si256(_mm256_srli_epi32(rule, BATCH_WRITE_SHIFT), low_byte);
+        _mm256_store_si256((__m256i *)address, cell);
+        _mm256_store_si256((__m256i *)write, written);
+        for (int i = 0; i < BATCHLANES; ++i)
+        {
+            if (moving_lanes & (1 << i))
+                cells[address[i]] = (unsigned char)write[i];
+        }
+
+        // -1 or 1 for moving lanes, 0 for the rest
+        __m256i right = _mm256_and_si256(_mm256_srli_epi32(rule, 16), one);
+        __m256i move = _mm256_and_si256(_mm256_sub_epi32(_mm256_add_epi32(right, right), one), moving);
+        position = _mm256_add_epi32(position, move);
+        current = _mm256_blendv_epi8(current, _mm256_and_si256(rule, low_byte), moving);
+        lo = _mm256_min_epi32(lo, position);
+        hi = _mm256_max_epi32(hi, position);
+        // a blank cell made non-blank counts one more, and the other way round one
+        // less (the comparisons are -1 where true)
+        __m256i change = _mm256_sub_epi32(_mm256_cmpeq_epi32(written, zero), _mm256_cmpeq_epi32(read, zero));
+        count = _mm256_add_epi32(count, _mm256_and_si256(change, moving));
+        n++;
+
+        __m256i outside = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(position, outside_bits), zero), moving);
+        if (!_mm256_testz_si256(_mm256_or_si256(halts, outside), _mm256_or_si256(halts, outside)))
+            break;
+    }
+
+    _mm256_storeu_si256((__m256i *)lane_current, current);
+    _mm256_storeu_si256((__m256i *)lane_position, position);
+    _mm256_storeu_si256((__m256i *)lane_min, lo);
+    _mm256_storeu_si256((__m256i *)lane_max, hi);
+    _mm256_storeu_si256((__m256i *)lane_count, count);
+    _mm256_storeu_si256((__m256i *)lane_read, read);
+    _mm256_storeu_si256((__m256i *)lane_rule, rule);
+
+    return n;
+}
+
+#else
+
+// advance() without AVX2 or AVX-512: the same lockstep loop, a lane at a time
+long long batch_engine::advance(long long steps)
+{
+    long long n = 0;
+
+    while (n < steps)
+    {
+        bool stop = false;
+
+        for (int i = 0; i < BATCHLANES; ++i)
+        {
+            if (!lane_busy[i])
+                continue;
+
+            unsigned char *cell = &tapes[i * BATCHSTRIDE + lane_position[i]];
+            int rule = programs[i * NUMSTT * NUMSYM + lane_current[i] + *cell];
+            lane_read[i] = *cell;
+            lane_rule[i] = rule;
+
+            if (rule & BATCH_HALTS)
+            {
+                stop = true;
+                continue;
+            }
+
+            unsigned char written = (unsigned char)((rule & BATCH_WRITE) >> BATCH_WRITE_SHIFT);
+            lane_count[i] += (written != BLANK) - (*cell != BLANK);
+            *cell = written;
+            lane_position[i] += (rule & BATCH_RIGHT) ? 1 : -1;
+            lane_current[i] = rule & BATCH_NEXT;
+            lane_min[i] = std::min(lane_min[i], lane_position[i]);
+            lane_max[i] = std::max(lane_max[i], lane_position[i]);
+            if (lane_position[i] & ~(BATCHTAPE - 1))
+                stop = true;
+        }
+
+        n++;
+        if (stop)
+            break;
+    }
+
+    return n;
+}
+
+#endif
+
+// Random rule-set number index of a seeded random search: rules like the ones
+// setupTransitionTable() makes, drawn from splitmix64 started at a point worked out
+// from the seed and the index alone
+void seededRuleset(tm_engine &machine, unsigned long long seed, long long index, int states, int symbols)
+{
+    unsigned long long x = seed ^ ((unsigned long long)index * 0xD1B54A32D192ED03ULL);
+    transition rule;
+
+    machine.setupTransitionTable(false);
+    for (int i = 0; i < states; ++i)
+    {
+        for (int j = 0; j < symbols; ++j)
+        {
+            int next = (int)(splitMix(x) % (unsigned long long)(states + 3));
+            rule.curr_state = (state)i;
+            rule.curr_symbol = (symbol)j;
+            rule.next_state = (state)(next < states ? next : NUMSTT + next - states);
+            rule.write_symbol = (symbol)(splitMix(x) % (unsigned long long)symbols);
+            rule.move_head = (direction)(splitMix(x) & 1);
+            machine.setRule(i, j, rule);
+        }
+    }
+}
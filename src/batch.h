@@ -0,0 +1,144 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Lockstep evaluation of many machines at once, for triaging large numbers of
+// (random) rule-sets. Each lane holds one machine, kept as structure-of-arrays
+// (state, tape head position and tape window of every lane side by side), and one
+// step advances every lane together: with AVX2 the cells under the tape heads and
+// the rules they select are fetched for all eight lanes by two gathers (sixteen
+// lanes with AVX-512), so a lane's
+// own rules never steer a branch. A lane whose machine halts or reaches the step
+// limit is refilled from the input straight away. A machine that walks off the
+// end of its tape window is handed over to tm_engine::run() to finish, so every
+// result is exactly what run() (or step()) would give.
+
+#include "engine.h"
+#include "search.h"
+#include "library.h"
+#include "decider.h"
+#include <stdio.h>
+#include <vector>
+
+// Machines stepped together (one vector of 32-bit lanes: 512 bits with AVX-512,
+// 256 bits otherwise)
+#ifdef __AVX512F__
+#define BATCHLANES 16
+#else
+#define BATCHLANES 8
+#endif
+// Cells of tape each lane has (a power of two); a machine starts in the middle
+#define BATCHTAPE 65536
+
+// splitmix64: the next of a stream of random numbers that is fully determined by its
+// starting value (and is the same on every platform, unlike rand())
+inline unsigned long long splitMix(unsigned long long &x)
+{
+    unsigned long long z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void seededRuleset(tm_engine &,unsigned long long,long long,int,int);
+
+// Where a batch engine gets its machines from, and hands back their results
+class batch_input
+{
+    public:
+        virtual ~batch_input() {}
+        // Set up the next machine's rule-set in machine.
+        // Returns false once there are no machines left.
+        virtual bool next(tm_engine &) = 0;
+        // The result of a machine (the index counts the machines next() has given,
+        // from 0). Machines finish in no particular order, and machine only holds
+        // the rule-set for certain (rule hit counts aren't kept).
+        virtual void finished(long long, tm_engine &, const run_result &) = 0;
+};
+
+// Rule-sets for a batch engine: random ones (as the 'r' key makes them), or machines
+// from a library. Results are written one line per machine to a file, the way
+// tnf_search writes them:
+//   halt <ticks> <rules>    the machine halts after <ticks> ticks
+//   unreachable <rules>     none of the machine's halting rules can ever be reached
+//                           (see backward_decider), so it isn't run
+//   undecided <rules>       the machine was still running at the step limit
+class triage_batch : public batch_input
+{
+    public:
+        triage_batch(long long,FILE *);
+        ~triage_batch();
+        void setLibrary(machine_library *,long long);
+        void setDedup(dedup_set *);
+        void setSize(int,int);
+        void setSeed(unsigned long long,long long);
+        bool next(tm_engine &);
+        void finished(long long,tm_engine &,const run_result &);
+        search_totals getTotals();
+    private:
+        void flushOutput();
+        void addLine(const char *,tm_engine &);
+        long long remaining;
+        // the library to take machines from (NULL for random ones), and the next
+        // machine to take
+        machine_library *library;
+        long long library_index;
+        // canonical forms of the machines run so far (NULL to run every machine)
+        dedup_set *seen;
+        backward_decider backward;
+        // states and symbols of the random rule-sets
+        int rule_states;
+        int rule_symbols;
+        // true to make rule-set i from the seed (see setSeed()), and the next i
+        bool seeded;
+        unsigned long long seed;
+        long long seed_index;
+        FILE *output;
+        std::string buffer;
+        search_totals totals;
+};
+
+class batch_engine
+{
+    public:
+        batch_engine(long long);
+        long long run(batch_input &);
+        long long getHandedOver();
+    private:
+        void fill(int);
+        void finish(int);
+        long long advance(long long);
+        batch_input *input;
+        long long max_steps;
+        // number of lockstep steps taken so far
+        long long iteration;
+        // number of machines started so far
+        long long started;
+        // number of machines finished by tm_engine::run()
+        long long handed_over;
+        // The machine in each lane (its rule-set, and its index in the input)
+        tm_engine machines[BATCHLANES];
+        long long lane_index[BATCHLANES];
+        // iteration at which the lane's machine started
+        long long lane_start[BATCHLANES];
+        // -1 for a lane with a machine in it, 0 for an empty one
+        int lane_busy[BATCHLANES];
+        // state * NUMSYM of each lane
+        int lane_current[BATCHLANES];
+        // tape head position (as an offset into the lane's window), and the lowest
+        // and highest position it has been at
+        int lane_position[BATCHLANES];
+        int lane_min[BATCHLANES];
+        int lane_max[BATCHLANES];
+        // number of non-blank cells in the lane's window
+        int lane_count[BATCHLANES];
+        // the symbol read and the (packed) rule used by the last step
+        int lane_read[BATCHLANES];
+        int lane_rule[BATCHLANES];
+        // Every lane's rule-set, packed one rule to an int (see fill()), lane after lane
+        std::vector<int> programs;
+        // Every lane's tape window, lane after lane (with room for the 4 bytes a
+        // gather reads)
+        std::vector<unsigned char> tapes;
+};
+
+#endif
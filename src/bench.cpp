@@ -0,0 +1,162 @@
+#include "bench.h"
+#include "macro.h"
+#include "rle.h"
+#include "sized.h"
+#include "hashlife.h"
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+static const bench_machine corpus[] =
+{
+    {"bb2",        "short halter", "bXrbXl_aXlHXr",                        1000},
+    {"bb3",        "short halter", "bXrH.l_bXlc.r_cXlaXl",                 1000},
+    {"bb2x3",      "short halter", "bXrb$lH.l_a$lb$rbXl",                  1000},
+    {"bb4",        "short halter", "bXrbXl_aXlc.l_HXrdXl_dXra.r",          1000},
+    {"bb2x4",      "long halter",  "bXra$laXraXr_bXlaXlb&rHXr",            10000000},
+    {"bb5",        "long halter",  "bXrcXl_cXrbXr_dXre.l_aXldXl_HXra.l",   100000000},
+    {"bouncer",    "sweeper",      "bXlaXr_aXrbXl",                        20000000},
+    {"loop38",     "cycler",       "bXrbXl_c.lb.r_a.rd.l_aXlH.l",          20000000},
+    {"drift452",   "translator",   "bXra.l_c.rH.l_dXrd.r_dXla.l",          20000000},
+    {"runaway",    "translator",   "aXr",                                  20000000}
+};
+
+static const char *engine_names[] = {"run", "step", "macro", "rle", "sized", "hashlife"};
+static const char *format_names[] = {"bytes", "packed", "bits"};
+
+// Memory the process has resident right now (KB)
+static long long residentKB()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (long long)(counters.WorkingSetSize / 1024);
+    return 0;
+#else
+    // /proc only exists on Linux; elsewhere the peak is the best there is
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL)
+    {
+        long long pages_total = 0, pages_resident = 0;
+        int read = fscanf(statm, "%lld %lld", &pages_total, &pages_resident);
+        fclose(statm);
+        if (read == 2)
+            return pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (long long)usage.ru_maxrss;
+#endif
+}
+
+// True if a machine only ever writes BLANK and CROSS (so it fits a TAPE_BITS tape)
+static bool twoSymbols(tm_engine &machine)
+{
+    for (int i = 0; i < NUMSTT; ++i)
+        for (int j = 0; j < NUMSYM; ++j)
+            if ((int)machine.getRule(i, j).write_symbol > (int)CROSS)
+                return false;
+    return true;
+}
+
+// Run one machine of the corpus one way, repeating it until BENCHMINTIME has passed,
+// and write a line of JSON about it
+static void benchOne(FILE *out, const bench_machine &bm, bench_engine engine, tape_format format)
+{
+    typedef std::chrono::steady_clock clock;
+
+    tm_engine machine;
+    machine.parseRuleset(bm.rules);
+
+    long long total_ticks = 0;
+    int runs = 0;
+    double seconds = 0;
+    run_result result;
+
+    do
+    {
+        machine.reset();
+        machine.getTape().setFormat(format);
+
+        clock::time_point start = clock::now();
+        if (engine == BENCH_RUN)
+        {
+            result = machine.run(bm.steps);
+        }
+        else if (engine == BENCH_STEP)
+        {
+            for (long long n = 0; n < bm.steps && machine.step(); ++n);
+            result = machine.getResult();
+        }
+        else if (engine == BENCH_MACRO)
+        {
+            macro_engine macro(machine, BENCHBLOCK);
+            result = macro.run(bm.steps);
+        }
+        else if (engine == BENCH_RLE)
+        {
+            rle_engine sweeper(machine);
+            result = sweeper.run(bm.steps);
+        }
+        else if (engine == BENCH_SIZED)
+        {
+            result = runSized(machine, bm.steps);
+        }
+        else
+        {
+            hashlife_engine memo(machine);
+            result = memo.run(bm.steps);
+        }
+        seconds += std::chrono::duration<double>(clock::now() - start).count();
+
+        total_ticks += result.ticks;
+        runs++;
+    } while (seconds < BENCHMINTIME);
+
+    double per_sec = seconds > 0 ? total_ticks / seconds : 0;
+    double ns = total_ticks > 0 ? seconds * 1e9 / total_ticks : 0;
+
+    fprintf(out, "{\"machine\":\"%s\",\"kind\":\"%s\",\"engine\":\"%s\",\"tape\":\"%s\","
+                 "\"ticks\":%lld,\"halted\":%s,\"runs\":%d,\"seconds\":%.6f,"
+                 "\"steps_per_sec\":%.0f,\"ns_per_step\":%.3f,\"span\":%lld,"
+                 "\"tape_bytes\":%lld,\"rss_kb\":%lld}\n",
+            bm.name, bm.kind, engine_names[engine], format_names[format],
+            result.ticks, result.halted ? "true" : "false", runs, seconds,
+            per_sec, ns, result.tape_max - result.tape_min + 1,
+            machine.getTape().getAllocatedBytes(), residentKB());
+    fflush(out);
+}
+
+// Run the whole corpus under every engine, and every tape format the engine steps
+// through (the macro, run-length, sized and hashlife engines keep their own form of
+// the tape).
+// Returns the program exit code.
+int runBenchmarks(FILE *out)
+{
+    for (size_t m = 0; m < sizeof(corpus) / sizeof(corpus[0]); ++m)
+    {
+        tm_engine machine;
+        machine.parseRuleset(corpus[m].rules);
+        bool bits = twoSymbols(machine);
+
+        for (int e = BENCH_RUN; e <= BENCH_HASHLIFE; ++e)
+        {
+            for (int f = TAPE_BYTES; f <= TAPE_BITS; ++f)
+            {
+                if (e != BENCH_RUN && e != BENCH_STEP && f != TAPE_BYTES)
+                    continue;
+                if (f == TAPE_BITS && !bits)
+                    continue;
+                benchOne(out, corpus[m], (bench_engine)e, (tape_format)f);
+            }
+        }
+    }
+
+    return 0;
+}
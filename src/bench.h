@@ -0,0 +1,40 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Benchmark suite: a fixed corpus of machines (short and long halters, sweepers,
+// cyclers and translators) run under every engine and tape format, with one line
+// of JSON per run so that results can be compared between builds.
+
+#include "engine.h"
+#include <stdio.h>
+
+// A machine of the benchmark corpus
+struct bench_machine
+{
+    const char *name;
+    // short halter, long halter, sweeper, cycler or translator
+    const char *kind;
+    const char *rules;
+    // ticks to run it for (halters halt well before this)
+    long long steps;
+};
+
+// Ways of running a machine
+enum bench_engine
+{
+    BENCH_RUN,       // tm_engine::run()
+    BENCH_STEP,      // tm_engine::step() in a loop
+    BENCH_MACRO,     // macro_engine with blocks of BENCHBLOCK cells
+    BENCH_RLE,       // rle_engine
+    BENCH_SIZED,     // runSized() (the step loop compiled for the machine's size)
+    BENCH_HASHLIFE   // hashlife_engine
+};
+
+// Block size for the macro engine
+#define BENCHBLOCK 8
+// A run is repeated until it has taken at least this many seconds in total
+#define BENCHMINTIME 0.2
+
+int runBenchmarks(FILE *);
+
+#endif
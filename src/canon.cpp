@@ -0,0 +1,130 @@
+#include "canon.h"
+#include <string.h>
+
+// The canonical form of a rule-set and its hash (64 bit FNV-1a).
+// States and symbols are numbered in the order they are first reached: rules are
+// visited from a queue that starts with state a reading BLANK, and whenever a rule
+// reaches a new state (or writes a new symbol) it is given the next number, and its
+// rules with every symbol (or the rules of every state with it) numbered so far join
+// the end of the queue, in number order. The order depends on nothing but the numbers
+// already given out, so renamed copies of a rule-set come out exactly the same.
+// Of the numbered rule-set and its mirror image, the one that packs to the smaller
+// bytes is kept: the one whose first rule that doesn't halt moves left.
+void canonicalize(const transition (*ruleset)[NUMSYM], canonical_form &form)
+{
+    int state_number[NUMSTT];
+    int symbol_number[NUMSYM];
+    int state_of[NUMSTT];
+    int symbol_of[NUMSYM];
+    // numbered state * NUMSYM + numbered symbol of the rules to visit
+    int queue[NUMSTT * NUMSYM];
+    int head = 0;
+    int tail = 0;
+
+    for (int i = 0; i < NUMSTT; ++i)
+        state_number[i] = -1;
+    for (int j = 0; j < NUMSYM; ++j)
+        symbol_number[j] = -1;
+
+    // state a and BLANK keep their numbers
+    int states = 1;
+    int symbols = 1;
+    state_number[STATE_QA] = 0;
+    state_of[0] = STATE_QA;
+    symbol_number[BLANK] = 0;
+    symbol_of[0] = BLANK;
+    queue[tail++] = 0;
+
+    // rules that are never reached stay at the default a/./left (packed as 0)
+    memset(form.rules, 0, RULESETBYTES);
+    // rules that are reached and don't halt (the ones mirroring changes)
+    bool moves[RULESETBYTES];
+    memset(moves, 0, sizeof(moves));
+
+    while (head < tail)
+    {
+        int s = queue[head] / NUMSYM;
+        int y = queue[head] % NUMSYM;
+        const transition &rule = ruleset[state_of[s]][symbol_of[y]];
+        transition numbered;
+
+        if (isHaltingState(rule.next_state))
+        {
+            numbered.next_state = rule.next_state;
+            numbered.write_symbol = BLANK;
+            numbered.move_head = LEFT;
+        }
+        else
+        {
+            int next = (int)rule.next_state;
+            int write = (int)rule.write_symbol;
+            if (state_number[next] < 0)
+            {
+                state_of[states] = next;
+                state_number[next] = states;
+                for (int k = 0; k < symbols; ++k)
+                    queue[tail++] = states * NUMSYM + k;
+                states++;
+            }
+            if (symbol_number[write] < 0)
+            {
+                symbol_of[symbols] = write;
+                symbol_number[write] = symbols;
+                for (int k = 0; k < states; ++k)
+                    queue[tail++] = k * NUMSYM + symbols;
+                symbols++;
+            }
+            numbered.next_state = (state)state_number[next];
+            numbered.write_symbol = (symbol)symbol_number[write];
+            numbered.move_head = rule.move_head;
+            moves[queue[head]] = true;
+        }
+        form.rules[queue[head]] = encodeRule(numbered);
+        head++;
+    }
+
+    // the first rule (in packed order) that moves decides the mirroring
+    // (the direction is the lowest bit of a packed rule)
+    int first = 0;
+    while (first < RULESETBYTES && !moves[first])
+        first++;
+    if (first < RULESETBYTES && (form.rules[first] & 1))
+    {
+        for (int k = first; k < RULESETBYTES; ++k)
+            if (moves[k])
+                form.rules[k] ^= 1;
+    }
+
+    form.hash = 14695981039346656037ULL;
+    for (int k = 0; k < RULESETBYTES; ++k)
+        form.hash = (form.hash ^ form.rules[k]) * 1099511628211ULL;
+}
+
+void canonicalize(tm_engine &machine, canonical_form &form)
+{
+    transition ruleset[NUMSTT][NUMSYM];
+    for (int i = 0; i < NUMSTT; ++i)
+        for (int j = 0; j < NUMSYM; ++j)
+            ruleset[i][j] = machine.getRule(i, j);
+    canonicalize(ruleset, form);
+}
+
+// Add a canonical form to the set. Returns false if it was already there.
+bool dedup_set::insert(const canonical_form &form)
+{
+    shard &s = shards[form.hash % DEDUPSHARDS];
+    std::lock_guard<std::mutex> guard(s.lock);
+    return s.forms.insert(std::string((const char *)form.rules, RULESETBYTES)).second;
+}
+
+// Number of different canonical forms in the set
+long long dedup_set::size()
+{
+    long long total = 0;
+    for (int i = 0; i < DEDUPSHARDS; ++i)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        total += (long long)shards[i].forms.size();
+    }
+    return total;
+}
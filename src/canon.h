@@ -0,0 +1,52 @@
+#ifndef CANON_H
+#define CANON_H
+
+// Canonical forms of rule-sets, for skipping machines that behave the same as one
+// already run. Two rule-sets get the same canonical form if one can be made into the
+// other by
+//   - renaming the non-halting states (state a stays the starting state),
+//   - renaming the symbols other than BLANK,
+//   - swapping left and right throughout (the tape then comes out mirrored),
+//   - changing rules the machine can never use: rules of states and symbols that
+//     can't be reached from state a on a blank tape, and the symbol and direction of
+//     halting rules (a halting rule doesn't write or move).
+// Such machines run for the same number of ticks and halt in the same halting state.
+// The canonical form is a rule-set in the packed form of a machine library record,
+// with its states and symbols numbered in the order they are first reached.
+
+#include "engine.h"
+#include "library.h"
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+// Number of independently locked parts of a dedup_set
+#define DEDUPSHARDS 64
+
+struct canonical_form
+{
+    unsigned char rules[RULESETBYTES];
+    unsigned long long hash;
+};
+
+void canonicalize(const transition (*)[NUMSYM],canonical_form &);
+void canonicalize(tm_engine &,canonical_form &);
+
+// The canonical forms of the machines seen so far, shared between threads. The set is
+// split into DEDUPSHARDS parts by hash, each with its own lock, so that threads
+// rarely wait on each other.
+class dedup_set
+{
+    public:
+        bool insert(const canonical_form &);
+        long long size();
+    private:
+        struct shard
+        {
+            std::mutex lock;
+            std::unordered_set<std::string> forms;
+        };
+        shard shards[DEDUPSHARDS];
+};
+
+#endif
@@ -0,0 +1,493 @@
+#include "decider.h"
+#include <climits>
+#include <string.h>
+
+// A cell of a backward search's configuration that nothing is known about
+#define BACKWARDUNKNOWN 0xFF
+
+// True if two machines are in exactly the same configuration: same state, tape head
+// location and tape contents (tick counts aren't compared)
+bool sameConfiguration(tm_engine &a, tm_engine &b)
+{
+    if (a.isHalted() != b.isHalted() ||
+        a.getTapeHead().getCurrentState() != b.getTapeHead().getCurrentState() ||
+        a.getTapeHead().getTapeHeadLoc() != b.getTapeHead().getTapeHeadLoc())
+        return false;
+
+    // Every non-blank cell of either tape lies within the allocated pages
+    long long a_first, a_last, b_first, b_last;
+    a.getTape().getAllocatedRange(a_first, a_last);
+    b.getTape().getAllocatedRange(b_first, b_last);
+
+    long long first = a_first < b_first ? a_first : b_first;
+    long long last = a_last > b_last ? a_last : b_last;
+    return a.getTape().equalWindow(first, b.getTape(), first, last - first + 1);
+}
+
+//
+// configuration hash implementation
+//
+
+config_hasher::config_hasher()
+{
+    // any odd number has an inverse mod 2^64; Newton's iteration finds it
+    // (each round doubles the number of correct low bits)
+    base = 0x9E3779B97F4A7C15ULL;
+    base_inverse = base;
+    for (int i = 0; i < 6; ++i)
+        base_inverse *= 2 - base * base_inverse;
+
+    tape_hash = 0;
+    head_power = 1;
+}
+
+// B^position (mod 2^64), for negative positions as well
+unsigned long long config_hasher::powerOf(long long position)
+{
+    unsigned long long factor = position >= 0 ? base : base_inverse;
+    unsigned long long exponent = (unsigned long long)(position >= 0 ? position : -position);
+    unsigned long long result = 1;
+
+    while (exponent > 0)
+    {
+        if (exponent & 1)
+            result *= factor;
+        factor *= factor;
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+// Work out the hash of a machine's configuration from scratch
+void config_hasher::attach(tm_engine &machine)
+{
+    long long first, last;
+    machine.getTape().getAllocatedRange(first, last);
+
+    tape_hash = 0;
+    unsigned long long power = powerOf(first);
+    for (long long i = first; i <= last; ++i)
+    {
+        tape_hash += (unsigned long long)machine.getTape().getTapeCell(i) * power;
+        power *= base;
+    }
+
+    head_power = powerOf(machine.getTapeHead().getTapeHeadLoc());
+}
+
+// Update the hash after the machine has taken a step from the given tape head location,
+// where the cell held the given symbol before the step
+void config_hasher::update(tm_engine &machine, long long position, symbol before)
+{
+    unsigned long long after = (unsigned long long)machine.getTape().getTapeCell(position);
+    tape_hash += (after - (unsigned long long)before) * head_power;
+
+    long long new_position = machine.getTapeHead().getTapeHeadLoc();
+    if (new_position > position)
+        head_power *= base;
+    else if (new_position < position)
+        head_power *= base_inverse;
+}
+
+// Step the machine one tick (see tm_engine::step()), updating the hash.
+// Returns false once the machine has halted.
+bool config_hasher::step(tm_engine &machine)
+{
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    symbol before = machine.getTape().getTapeCell(position);
+
+    bool moved = machine.step();
+    update(machine, position, before);
+
+    return moved;
+}
+
+// Hash of the machine's whole configuration
+unsigned long long config_hasher::getHash(tm_engine &machine)
+{
+    unsigned long long h = tape_hash;
+    h ^= (unsigned long long)machine.getTapeHead().getCurrentState() * 0xC2B2AE3D27D4EB4FULL;
+    h ^= (unsigned long long)machine.getTapeHead().getTapeHeadLoc() * 0x165667B19E3779F9ULL;
+
+    // final mix so that nearby configurations don't give nearby hashes
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+//
+// cycler decider implementation
+//
+
+// Get ready to watch a machine from its current configuration
+void cycler_decider::start(tm_engine &machine)
+{
+    initial = machine;
+    hasher.attach(machine);
+    saved = machine;
+    saved_hash = hasher.getHash(machine);
+    power = 1;
+    period = 0;
+}
+
+// Check the machine after it has taken a step from the given tape head location (where
+// the cell held the given symbol before the step). Returns true, filling in the result,
+// if the machine is back in a configuration it has been in before.
+bool cycler_decider::check(tm_engine &machine, long long position, symbol before, decider_result &result)
+{
+    hasher.update(machine, position, before);
+
+    period++;
+    unsigned long long h = hasher.getHash(machine);
+
+    if (h == saved_hash && sameConfiguration(machine, saved))
+    {
+        result.kind = VERDICT_LOOPS;
+        result.ticks = machine.getTicks();
+        result.period = period;
+        result.shift = 0;
+
+        // The loop starts at the first tick where a copy of the machine and a copy
+        // running period ticks ahead of it are in the same configuration
+        tm_engine trail = initial;
+        tm_engine lead = initial;
+        config_hasher trail_hasher, lead_hasher;
+        trail_hasher.attach(trail);
+        lead_hasher.attach(lead);
+
+        for (long long i = 0; i < result.period; ++i)
+            lead_hasher.step(lead);
+
+        while (lead_hasher.getHash(lead) != trail_hasher.getHash(trail) || !sameConfiguration(lead, trail))
+        {
+            lead_hasher.step(lead);
+            trail_hasher.step(trail);
+        }
+
+        result.loop_start = trail.getTicks();
+        return true;
+    }
+
+    // Brent's algorithm: move the saved configuration forward at powers of 2
+    if (period == power)
+    {
+        saved = machine;
+        saved_hash = h;
+        power *= 2;
+        period = 0;
+    }
+
+    return false;
+}
+
+// Run the machine for up to max_steps more ticks, looking for a repeated configuration.
+// The machine is left where the verdict was reached.
+decider_result cycler_decider::decide(tm_engine &machine, long long max_steps)
+{
+    decider_result result;
+    result.kind = VERDICT_UNDECIDED;
+    result.loop_start = result.period = result.shift = 0;
+
+    start(machine);
+
+    for (long long i = 0; i < max_steps; ++i)
+    {
+        long long position = machine.getTapeHead().getTapeHeadLoc();
+        symbol before = machine.getTape().getTapeCell(position);
+
+        if (!machine.step())
+        {
+            result.kind = machine.isHalted() ? VERDICT_HALTS : VERDICT_UNDECIDED;
+            break;
+        }
+        if (check(machine, position, before, result))
+            return result;
+    }
+
+    result.ticks = machine.getTicks();
+    return result;
+}
+
+//
+// translated cycler decider implementation
+//
+
+// Get ready to watch a machine from its current configuration
+void translated_cycler_decider::start(tm_engine &machine)
+{
+    right_records.clear();
+    left_records.clear();
+
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    right_edge = left_edge = position;
+    right_back = left_back = position;
+
+    // find the outermost non-blank cells already on the tape
+    if (!machine.getTape().findExtent(first_written, last_written))
+    {
+        first_written = LLONG_MAX;
+        last_written = LLONG_MIN;
+    }
+}
+
+// Check the machine after it has taken a step. Returns true, filling in the result, if
+// the tape head has reached a new edge in the same state and with the same tape behind
+// it as at an earlier edge.
+bool translated_cycler_decider::check(tm_engine &machine, decider_result &result)
+{
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+
+    if (position < right_back)
+        right_back = position;
+    if (position > left_back)
+        left_back = position;
+
+    if (position > right_edge)
+    {
+        right_edge = position;
+        // every cell right of the tape head has to be blank for a record to count
+        if (position >= last_written)
+            return checkSide(machine, right_records, 1, result);
+    }
+    else if (position < left_edge)
+    {
+        left_edge = position;
+        if (position <= first_written)
+            return checkSide(machine, left_records, -1, result);
+    }
+
+    return false;
+}
+
+// Add a record for the tape head's current position at one edge (dir is 1 for the right
+// edge, -1 for the left), and compare it with the earlier records at that edge.
+bool translated_cycler_decider::checkSide(tm_engine &machine, std::deque<record> &records, int dir, decider_result &result)
+{
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    long long &back = dir > 0 ? right_back : left_back;
+
+    records.push_back(record());
+    record &latest = records.back();
+    latest.tick = machine.getTicks();
+    latest.position = position;
+    latest.record_state = machine.getTapeHead().getCurrentState();
+    latest.furthest_back = back;
+    for (int k = 0; k < RECORDWINDOW; ++k)
+        latest.window[k] = (unsigned char)machine.getTape().getTapeCell(position - dir * k);
+
+    back = position;
+
+    if (records.size() > RECORDHISTORY + 1)
+        records.pop_front();
+
+    // Work backwards through the earlier records, keeping track of how far back the
+    // tape head went between each of them and now. Distances are measured in the
+    // direction of the edge (dir * position), so both edges work the same way.
+    long long furthest_back = LLONG_MAX;
+    for (int i = (int)records.size() - 2; i >= 0; --i)
+    {
+        const record &earlier = records[i];
+
+        if (dir * records[i + 1].furthest_back < furthest_back)
+            furthest_back = dir * records[i + 1].furthest_back;
+
+        // number of cells behind the earlier record the tape head went back over
+        long long distance = dir * earlier.position - furthest_back;
+
+        if (earlier.record_state != latest.record_state || distance >= RECORDWINDOW)
+            continue;
+
+        // Everything the tape head went back over since the earlier record has to match
+        bool match = true;
+        for (long long k = 0; k <= distance && match; ++k)
+            match = earlier.window[k] == latest.window[k];
+
+        if (match)
+        {
+            result.kind = VERDICT_TRANSLATES;
+            result.ticks = latest.tick;
+            result.loop_start = earlier.tick;
+            result.period = latest.tick - earlier.tick;
+            result.shift = latest.position - earlier.position;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Run the machine for up to max_steps more ticks, looking for a translated cycle.
+// The machine is left where the verdict was reached.
+decider_result translated_cycler_decider::decide(tm_engine &machine, long long max_steps)
+{
+    decider_result result;
+    result.kind = VERDICT_UNDECIDED;
+    result.loop_start = result.period = result.shift = 0;
+
+    start(machine);
+
+    for (long long i = 0; i < max_steps; ++i)
+    {
+        if (!machine.step())
+        {
+            result.kind = machine.isHalted() ? VERDICT_HALTS : VERDICT_UNDECIDED;
+            break;
+        }
+        if (check(machine, result))
+            return result;
+    }
+
+    result.ticks = machine.getTicks();
+    return result;
+}
+
+//
+// backward reasoning decider implementation
+//
+
+// True if the configuration being worked back from agrees with the machine's own: the
+// same state, and every known cell the same as the machine's tape around its tape head
+bool backward_decider::matchesMachine()
+{
+    if (current_state != machine_state)
+        return false;
+
+    const unsigned char *tape_cells = &machine_cells[2 * BACKWARDDEPTH - head];
+    for (int i = 0; i < 2 * BACKWARDDEPTH + 1; ++i)
+    {
+        if (cells[i] != BACKWARDUNKNOWN && cells[i] != tape_cells[i])
+            return false;
+    }
+    return true;
+}
+
+// True if every chain of configurations leading to the current one (depth steps back
+// from a halting rule) comes to an end without reaching the machine's configuration
+bool backward_decider::dies(int depth)
+{
+    if (matchesMachine() || depth == BACKWARDDEPTH || ++visited > BACKWARDNODES)
+        return false;
+
+    const std::vector<predecessor> &rules = leading_to[(int)current_state];
+    for (size_t i = 0; i < rules.size(); ++i)
+    {
+        const predecessor &rule = rules[i];
+        // the rule was used one cell back, and what it wrote there has to be there
+        int from = head - rule.move;
+        unsigned char known = cells[from];
+        if (known != BACKWARDUNKNOWN && known != (unsigned char)rule.write)
+            continue;
+
+        state later_state = current_state;
+        int later_head = head;
+        cells[from] = (unsigned char)rule.read;
+        current_state = rule.from_state;
+        head = from;
+
+        bool ends = dies(depth + 1);
+
+        head = later_head;
+        current_state = later_state;
+        cells[from] = known;
+        if (!ends)
+            return false;
+    }
+
+    return true;
+}
+
+// Work back from every halting rule of the machine, to prove that none of them can be
+// reached from its configuration (VERDICT_UNREACHABLE). The machine isn't run.
+decider_result backward_decider::decide(tm_engine &m)
+{
+    decider_result result;
+    result.kind = VERDICT_UNDECIDED;
+    result.ticks = m.getTicks();
+    result.loop_start = result.period = result.shift = 0;
+
+    if (m.isHalted())
+    {
+        result.kind = VERDICT_HALTS;
+        return result;
+    }
+
+    machine_state = m.getTapeHead().getCurrentState();
+    long long position = m.getTapeHead().getTapeHeadLoc();
+    for (int i = 0; i < 4 * BACKWARDDEPTH + 1; ++i)
+        machine_cells[i] = (unsigned char)m.getTape().getTapeCell(position + i - 2 * BACKWARDDEPTH);
+
+    for (int i = 0; i < NUMSTT; ++i)
+        leading_to[i].clear();
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            const transition &rule = m.getRule(i, j);
+            if (isHaltingState(rule.next_state))
+                continue;
+            predecessor p;
+            p.from_state = (state)i;
+            p.read = (symbol)j;
+            p.write = rule.write_symbol;
+            p.move = rule.move_head == LEFT ? -1 : 1;
+            leading_to[(int)rule.next_state].push_back(p);
+        }
+    }
+
+    visited = 0;
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            if (!isHaltingState(m.getRule(i, j).next_state))
+                continue;
+
+            // the halting rule is about to be used: only the cell it reads is known
+            memset(cells, BACKWARDUNKNOWN, sizeof(cells));
+            head = BACKWARDDEPTH;
+            cells[head] = (unsigned char)j;
+            current_state = (state)i;
+            if (!dies(0))
+                return result;
+        }
+    }
+
+    result.kind = VERDICT_UNREACHABLE;
+    return result;
+}
+
+// Run a machine for up to max_steps more ticks under every decider, stopping as soon
+// as it halts or one of them proves it never will. A machine none of whose halting
+// rules can be reached isn't run at all.
+decider_result decideMachine(tm_engine &machine, long long max_steps)
+{
+    backward_decider backward;
+    decider_result result = backward.decide(machine);
+    if (result.kind == VERDICT_UNREACHABLE)
+        return result;
+    result.kind = VERDICT_UNDECIDED;
+
+    cycler_decider cycler;
+    translated_cycler_decider translated;
+    cycler.start(machine);
+    translated.start(machine);
+
+    for (long long i = 0; i < max_steps; ++i)
+    {
+        long long position = machine.getTapeHead().getTapeHeadLoc();
+        symbol before = machine.getTape().getTapeCell(position);
+
+        if (!machine.step())
+        {
+            result.kind = machine.isHalted() ? VERDICT_HALTS : VERDICT_UNDECIDED;
+            break;
+        }
+        if (cycler.check(machine, position, before, result) || translated.check(machine, result))
+            return result;
+    }
+
+    result.ticks = machine.getTicks();
+    return result;
+}
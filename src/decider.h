@@ -0,0 +1,174 @@
+#ifndef DECIDER_H
+#define DECIDER_H
+
+// Deciders: ways of proving that a machine never halts, so that batch runs can
+// drop it long before the step limit.
+
+#include "engine.h"
+#include <deque>
+#include <vector>
+
+// What a decider found out about a machine
+enum verdict
+{
+	VERDICT_HALTS,       // it halted (ticks is when)
+	VERDICT_LOOPS,       // it repeats a configuration forever
+	VERDICT_TRANSLATES,  // it repeats a configuration forever, shifted along the tape
+	VERDICT_UNREACHABLE, // no halting rule can ever be reached from its configuration
+	VERDICT_UNDECIDED    // nothing proven within the step limit
+};
+
+struct decider_result
+{
+    verdict kind;
+    // ticks the machine had run when the verdict was reached
+    long long ticks;
+    // for VERDICT_LOOPS: the configuration at tick loop_start repeats every
+    // period ticks from then on
+    // for VERDICT_TRANSLATES: the same, except that every period ticks the
+    // configuration has moved shift cells along the tape
+    long long loop_start;
+    long long period;
+    long long shift;
+};
+
+// Incrementally maintained hash of a machine's whole configuration (state, tape
+// head location and every non-blank cell). Each tape cell contributes
+// symbol * B^position, so a step only changes one term and the hash is updated in
+// O(1) no matter how much tape has been written.
+class config_hasher
+{
+    public:
+        config_hasher();
+        void attach(tm_engine &);
+        void update(tm_engine &,long long,symbol);
+        bool step(tm_engine &);
+        unsigned long long getHash(tm_engine &);
+    private:
+        unsigned long long powerOf(long long);
+        // sum of symbol * B^position over the tape
+        unsigned long long tape_hash;
+        // B^position of the tape head
+        unsigned long long head_power;
+        // B and its multiplicative inverse (mod 2^64)
+        unsigned long long base;
+        unsigned long long base_inverse;
+};
+
+// Cycler decider: notices a machine returning to a configuration it has been in
+// before. Configurations are only compared at Brent-style checkpoints (the saved
+// configuration is replaced at ticks 1, 2, 4, 8...), so no history is kept, and a
+// hash match is confirmed by comparing the configurations exactly.
+class cycler_decider
+{
+    public:
+        void start(tm_engine &);
+        bool check(tm_engine &,long long,symbol,decider_result &);
+        decider_result decide(tm_engine &,long long);
+    private:
+        // copy of the machine when the decider started (to find where a loop starts)
+        tm_engine initial;
+        config_hasher hasher;
+        // configuration saved at the last checkpoint
+        tm_engine saved;
+        unsigned long long saved_hash;
+        long long power;
+        long long period;
+};
+
+// Number of cells behind the tape head kept with each record (longest window
+// a translated cycler can be proven with)
+#define RECORDWINDOW 256
+// Number of earlier records (on each side) a new record is compared with
+#define RECORDHISTORY 64
+
+// Translated cycler decider: for machines that never repeat a configuration because
+// they keep moving into fresh blank tape. Each time the tape head reaches a new
+// rightmost (or leftmost) cell, the state and the tape window behind the head are
+// recorded. If an earlier record had the same state and the same window, where
+// the window covers every cell the head went back to in between, the machine will
+// repeat what it did between the two records forever, shifted along the tape.
+class translated_cycler_decider
+{
+    public:
+        void start(tm_engine &);
+        bool check(tm_engine &,decider_result &);
+        decider_result decide(tm_engine &,long long);
+    private:
+        struct record
+        {
+            long long tick;
+            long long position;
+            state record_state;
+            // furthest the tape head went back (away from the edge) between the
+            // previous record and this one
+            long long furthest_back;
+            // the RECORDWINDOW cells from the record position backwards
+            unsigned char window[RECORDWINDOW];
+        };
+        bool checkSide(tm_engine &,std::deque<record> &,int,decider_result &);
+        // records at the right and left edges, newest last
+        std::deque<record> right_records;
+        std::deque<record> left_records;
+        // edges of the tape the head has reached so far
+        long long right_edge;
+        long long left_edge;
+        // furthest back the tape head has gone since the last record on each side
+        long long right_back;
+        long long left_back;
+        // cells at or beyond these were non-blank when the decider started, so records
+        // are only kept once the head is past them (where the tape is known to be blank)
+        long long first_written;
+        long long last_written;
+};
+
+// Most steps back from a halting rule a backward search takes, and most
+// configurations it looks at in all (past either it gives up)
+#define BACKWARDDEPTH 24
+#define BACKWARDNODES 2000
+
+// Backward reasoning decider: for machines whose halting rules can never fire. It
+// starts from each rule that halts (a configuration where only the cell under the
+// tape head is known) and works out every configuration one step earlier that could
+// have led there: a rule going to that state, used one cell back, which wrote what
+// the configuration has in that cell (or anything, if the cell isn't known yet). The
+// earlier configuration knows the cell held the symbol the rule reads. If every chain
+// of earlier configurations comes to an end (no rule could have led there) without
+// one of them agreeing with the machine's own configuration, no run from it can
+// ever halt. Nothing is run, so the machine is left as it is.
+class backward_decider
+{
+    public:
+        decider_result decide(tm_engine &);
+    private:
+        // A rule that goes to a given (non-halting) state: the state and symbol it
+        // is used for, the symbol it writes and its move (-1 or 1)
+        struct predecessor
+        {
+            state from_state;
+            symbol read;
+            symbol write;
+            int move;
+        };
+        bool dies(int);
+        bool matchesMachine();
+        // the machine's state, and its tape from 2 * BACKWARDDEPTH cells left of
+        // its tape head to as many right of it
+        state machine_state;
+        unsigned char machine_cells[4 * BACKWARDDEPTH + 1];
+        // the rules going to each state
+        std::vector<predecessor> leading_to[NUMSTT];
+        // The configuration being worked back from: its state, the tape head's
+        // offset into cells, and the cells around where the search started
+        // (BACKWARDUNKNOWN for cells nothing has been found out about)
+        state current_state;
+        int head;
+        unsigned char cells[2 * BACKWARDDEPTH + 1];
+        // configurations looked at so far
+        long long visited;
+};
+
+bool sameConfiguration(tm_engine &,tm_engine &);
+decider_result decideMachine(tm_engine &,long long);
+
+#endif
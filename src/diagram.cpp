@@ -0,0 +1,345 @@
+#include "diagram.h"
+#include "sized.h"
+#include <algorithm>
+#include <string.h>
+
+// Colour of each symbol (blank being black, so that a canvas of zeros is blank tape),
+// and of the tape head
+static const unsigned char symbol_rgb[NUMSYM][3] =
+{
+    {0, 0, 0},        // .
+    {255, 255, 255},  // X
+    {255, 255, 0},    // $
+    {0, 255, 255},    // &
+    {64, 128, 255},   // 0
+    {0, 255, 0}       // 1
+};
+
+static const unsigned char head_rgb[3] = {255, 0, 0};
+
+// A canvas of width x height pixels (width is made even, and both at least 2)
+spacetime_diagram::spacetime_diagram(int w, int h)
+{
+    width = std::max(2, w + (w & 1));
+    height = std::max(2, h);
+    first_cell = 0;
+    cells_per_column = 1;
+    tape_lo = tape_hi = 0;
+    start_tick = 0;
+    ticks_per_row = 1;
+    rows = 0;
+}
+
+// Start a diagram of the machine from where it is now, with the columns covering the
+// tape it has written and its tape head
+void spacetime_diagram::start(tm_engine &machine)
+{
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    long long first, last;
+    if (!machine.getTape().findExtent(first, last))
+        first = last = position;
+    long long lo = std::min(first, position);
+    long long hi = std::max(last, position);
+
+    cells_per_column = 1;
+    while ((long long)width * cells_per_column < hi - lo + 1)
+        cells_per_column *= 2;
+    first_cell = lo - ((long long)width * cells_per_column - (hi - lo + 1)) / 2;
+    tape_lo = lo;
+    tape_hi = hi;
+
+    start_tick = machine.getTicks();
+    ticks_per_row = 1;
+    rows = 0;
+    sums.assign((size_t)width * height * 3, 0);
+    heads.assign((size_t)width * height, 0);
+    samples.assign((size_t)height, 0);
+}
+
+// Ticks the machine should run between samples, as things stand
+long long spacetime_diagram::getInterval()
+{
+    return std::max(1LL, ticks_per_row / DIAGRAMSAMPLES);
+}
+
+// Average every two rows into one: a row is twice as many ticks from now on
+void spacetime_diagram::mergeRows()
+{
+    size_t w = (size_t)width;
+    for (int r = 0; r < height / 2; ++r)
+    {
+        size_t to = (size_t)r;
+        size_t from = (size_t)(2 * r);
+        for (size_t k = 0; k < w * 3; ++k)
+            sums[to * w * 3 + k] = sums[from * w * 3 + k] + sums[(from + 1) * w * 3 + k];
+        for (size_t k = 0; k < w; ++k)
+            heads[to * w + k] = heads[from * w + k] + heads[(from + 1) * w + k];
+        samples[to] = samples[from] + samples[from + 1];
+    }
+    // (an odd row left over is the first of the next pair)
+    int kept = height / 2;
+    if (height & 1)
+    {
+        memmove(&sums[(size_t)kept * w * 3], &sums[(size_t)(height - 1) * w * 3], w * 3 * sizeof(unsigned int));
+        memmove(&heads[(size_t)kept * w], &heads[(size_t)(height - 1) * w], w * sizeof(unsigned int));
+        samples[(size_t)kept] = samples[(size_t)(height - 1)];
+        kept++;
+    }
+    std::fill(sums.begin() + (size_t)kept * w * 3, sums.end(), 0);
+    std::fill(heads.begin() + (size_t)kept * w, heads.end(), 0);
+    std::fill(samples.begin() + kept, samples.end(), 0);
+
+    rows = (rows + 1) / 2;
+    ticks_per_row *= 2;
+}
+
+// Average every two columns into one, so the canvas covers twice as many cells: the new
+// cells are on the left if left is true (on the right otherwise). They are drawn blank
+// in the rows so far, which is what they held, since the tape head hadn't been there.
+void spacetime_diagram::widen(bool left)
+{
+    int half = width / 2;
+    for (int r = 0; r < rows; ++r)
+    {
+        unsigned int *row = &sums[(size_t)r * width * 3];
+        unsigned int *row_heads = &heads[(size_t)r * width];
+
+        // (in an order that never overwrites a column still to be read)
+        for (int n = 0; n < half; ++n)
+        {
+            int j = left ? half - 1 - n : n;
+            int to = left ? half + j : j;
+            for (int c = 0; c < 3; ++c)
+                row[to * 3 + c] = (row[2 * j * 3 + c] + row[(2 * j + 1) * 3 + c]) / 2;
+            row_heads[to] = row_heads[2 * j] + row_heads[2 * j + 1];
+        }
+        int blank = left ? 0 : half;
+        std::fill(row + blank * 3, row + (blank + half) * 3, 0);
+        std::fill(row_heads + blank, row_heads + blank + half, 0);
+    }
+
+    if (left)
+        first_cell -= (long long)width * cells_per_column;
+    cells_per_column *= 2;
+}
+
+// Add the machine's tape as it is now to the row for its tick
+void spacetime_diagram::sample(tm_engine &machine)
+{
+    long long row = (machine.getTicks() - start_tick) / ticks_per_row;
+    while (row >= height)
+    {
+        mergeRows();
+        row = (machine.getTicks() - start_tick) / ticks_per_row;
+    }
+    rows = std::max(rows, (int)row + 1);
+
+    // every cell the tape head has been above has to be on the canvas
+    run_result now = machine.getResult();
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    long long lo = std::min(std::min(now.tape_min, position), tape_lo);
+    long long hi = std::max(std::max(now.tape_max, position), tape_hi);
+    while (lo < first_cell)
+        widen(true);
+    while (hi >= first_cell + (long long)width * cells_per_column)
+        widen(false);
+
+    // a few cells of each column, spread out over it (the columns beyond the tape head's
+    // span and what was written at the start are blank, and add nothing)
+    long long cells = std::min(cells_per_column, (long long)DIAGRAMCELLS);
+    long long stride = cells_per_column / cells;
+    tape &t = machine.getTape();
+    unsigned int *pixel = &sums[(size_t)row * width * 3];
+    int first_column = (int)((lo - first_cell) / cells_per_column);
+    int last_column = (int)((hi - first_cell) / cells_per_column);
+
+    for (int j = first_column; j <= last_column; ++j)
+    {
+        long long cell = first_cell + (long long)j * cells_per_column;
+        unsigned int rgb[3] = {0, 0, 0};
+        for (long long k = 0; k < cells; ++k)
+        {
+            const unsigned char *colour = symbol_rgb[(int)t.getTapeCell(cell + k * stride)];
+            for (int c = 0; c < 3; ++c)
+                rgb[c] += colour[c];
+        }
+        for (int c = 0; c < 3; ++c)
+            pixel[j * 3 + c] += rgb[c] / (unsigned int)cells;
+    }
+
+    heads[(size_t)row * width + (size_t)((position - first_cell) / cells_per_column)]++;
+    samples[(size_t)row]++;
+}
+
+// The colours of a row of the picture
+void spacetime_diagram::pixelRow(int r, std::vector<unsigned char> &out)
+{
+    out.resize((size_t)width * 3);
+    unsigned int n = std::max(1u, samples[(size_t)r]);
+
+    for (int j = 0; j < width; ++j)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            if (heads[(size_t)r * width + j] > 0)
+                out[j * 3 + c] = head_rgb[c];
+            else
+                out[j * 3 + c] = (unsigned char)(sums[((size_t)r * width + j) * 3 + c] / n);
+        }
+    }
+}
+
+// Write the picture as a binary PPM (P6)
+bool spacetime_diagram::writePPM(FILE *out)
+{
+    std::vector<unsigned char> line;
+    fprintf(out, "P6\n%d %d\n255\n", width, rows);
+
+    for (int r = 0; r < rows; ++r)
+    {
+        pixelRow(r, line);
+        if (fwrite(&line[0], 1, line.size(), out) != line.size())
+            return false;
+    }
+    return true;
+}
+
+// CRC-32 (as PNG chunks use it) of some bytes, carrying on from crc
+static unsigned int crc32(unsigned int crc, const unsigned char *bytes, size_t count)
+{
+    static unsigned int table[256];
+    static bool ready = false;
+    if (!ready)
+    {
+        for (unsigned int n = 0; n < 256; ++n)
+        {
+            unsigned int c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        ready = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < count; ++i)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char> &out, unsigned int value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((unsigned char)(value >> shift));
+}
+
+// Write one PNG chunk: its length, type, data and CRC
+static bool writeChunk(FILE *out, const char *type, const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char> chunk;
+    putBigEndian(chunk, (unsigned int)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+    return fwrite(&chunk[0], 1, chunk.size(), out) == chunk.size();
+}
+
+// Write the picture as a PNG. The image data is a zlib stream of stored (uncompressed)
+// deflate blocks, an IDAT chunk per row, so no compression library is needed and only
+// a row is ever held at a time.
+bool spacetime_diagram::writePNG(FILE *out)
+{
+    static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    if (fwrite(signature, 1, 8, out) != 8)
+        return false;
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, (unsigned int)width);
+    putBigEndian(header, (unsigned int)rows);
+    // 8 bits per channel, RGB, deflate, standard filters, not interlaced
+    const unsigned char rest[5] = {8, 2, 0, 0, 0};
+    header.insert(header.end(), rest, rest + 5);
+    if (!writeChunk(out, "IHDR", header))
+        return false;
+
+    std::vector<unsigned char> line;
+    std::vector<unsigned char> data;
+    // Adler-32 of everything the zlib stream holds
+    unsigned int adler_a = 1, adler_b = 0;
+
+    for (int r = 0; r < rows; ++r)
+    {
+        pixelRow(r, line);
+        // filter type 0 (none) ahead of the row
+        line.insert(line.begin(), 0);
+        for (size_t i = 0; i < line.size(); ++i)
+        {
+            adler_a = (adler_a + line[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+
+        data.clear();
+        if (r == 0)
+        {
+            // zlib header: deflate with a 32K window, no dictionary, fastest
+            data.push_back(0x78);
+            data.push_back(0x01);
+        }
+        // as many stored blocks as the row needs (at most 65535 bytes each)
+        for (size_t done = 0; done < line.size(); )
+        {
+            size_t n = std::min(line.size() - done, (size_t)65535);
+            bool final = r == rows - 1 && done + n == line.size();
+            data.push_back(final ? 1 : 0);
+            data.push_back((unsigned char)(n & 0xFF));
+            data.push_back((unsigned char)(n >> 8));
+            data.push_back((unsigned char)(~n & 0xFF));
+            data.push_back((unsigned char)((~n >> 8) & 0xFF));
+            data.insert(data.end(), line.begin() + done, line.begin() + done + n);
+            done += n;
+        }
+        if (r == rows - 1)
+            putBigEndian(data, adler_b << 16 | adler_a);
+        if (!writeChunk(out, "IDAT", data))
+            return false;
+    }
+
+    return writeChunk(out, "IEND", std::vector<unsigned char>());
+}
+
+// Write the picture to a file: a PNG if its name ends in .png, a PPM otherwise.
+// Returns false if it couldn't be written.
+bool spacetime_diagram::write(const char *name)
+{
+    FILE *out = fopen(name, "wb");
+    if (out == NULL)
+        return false;
+
+    size_t length = strlen(name);
+    bool png = length >= 4 && strcmp(name + length - 4, ".png") == 0;
+    bool ok = png ? writePNG(out) : writePPM(out);
+    return fclose(out) == 0 && ok;
+}
+
+// Run the machine for at most max_steps more ticks (as tm_engine::run() does, or with
+// runSized() between samples if sized), drawing it into the diagram from where it is now
+run_result runDiagram(tm_engine &machine, long long max_steps, spacetime_diagram &diagram, bool sized)
+{
+    diagram.start(machine);
+    diagram.sample(machine);
+
+    for (long long remaining = max_steps; remaining > 0 && !machine.isHalted(); )
+    {
+        long long n = std::min(remaining, diagram.getInterval());
+        // runSized() copies the tape span in and out, so it only pays for longer runs
+        run_result now = machine.getResult();
+        if (sized && n >= now.tape_max - now.tape_min + 1)
+            runSized(machine, n);
+        else
+            machine.run(n);
+        remaining -= n;
+        diagram.sample(machine);
+    }
+
+    return machine.getResult();
+}
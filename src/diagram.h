@@ -0,0 +1,69 @@
+#ifndef DIAGRAM_H
+#define DIAGRAM_H
+
+// Space-time diagram of a run: a row per moment, a column per cell, each pixel
+// coloured by the symbol in the cell and the tape head's cells marked, written as a
+// PPM or PNG image. However long the run and however wide the tape, the picture is a
+// fixed canvas of width x height pixels, so memory never grows with the run:
+//   - a row starts out as one tick. Once the rows are all used, neighbouring rows are
+//     averaged together (halving the rows in use) and a row stands for twice as many
+//     ticks from then on.
+//   - a column starts out as one cell (or as many as the tape already written needs).
+//     Once the tape head goes beyond the columns, neighbouring columns are averaged
+//     together and the canvas covers twice as many cells, the new half on the side
+//     the tape head went.
+// The tape is only looked at DIAGRAMSAMPLES times a row (every tick while a row is one
+// tick), so a diagram is drawn alongside the fast engines: the machine is run between
+// samples with run() (or runSized() with --sized), and each sample reads a few cells
+// per column.
+
+#include "engine.h"
+#include <stdio.h>
+#include <vector>
+
+// Samples of the tape a row of the diagram is made from (once a row is more ticks)
+#define DIAGRAMSAMPLES 4
+// Cells read per column in a sample (spread over the cells the column covers)
+#define DIAGRAMCELLS 8
+// Size of the canvas unless given
+#define DIAGRAMWIDTH 1024
+#define DIAGRAMHEIGHT 1024
+
+class spacetime_diagram
+{
+    public:
+        spacetime_diagram(int,int);
+        void start(tm_engine &);
+        void sample(tm_engine &);
+        long long getInterval();
+        bool write(const char *);
+    private:
+        void widen(bool);
+        void mergeRows();
+        bool writePPM(FILE *);
+        bool writePNG(FILE *);
+        void pixelRow(int,std::vector<unsigned char> &);
+        int width;
+        int height;
+        // tape position of column 0's first cell, and cells per column (a power of 2)
+        long long first_cell;
+        long long cells_per_column;
+        // cells written (or under the tape head) at the start
+        long long tape_lo;
+        long long tape_hi;
+        // tick of row 0, and ticks per row (a power of 2)
+        long long start_tick;
+        long long ticks_per_row;
+        // rows drawn in so far
+        int rows;
+        // For every pixel (row by row): red, green and blue added up over the samples
+        // of its row, and the number of samples with the tape head in its cells
+        std::vector<unsigned int> sums;
+        std::vector<unsigned int> heads;
+        // number of samples added to each row
+        std::vector<unsigned int> samples;
+};
+
+run_result runDiagram(tm_engine &,long long,spacetime_diagram &,bool);
+
+#endif
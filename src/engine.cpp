@@ -0,0 +1,972 @@
+#include "engine.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// tape head class implementation
+//
+
+tape_head::tape_head()
+{
+    // Initialize the location of the tape head to cell 0.
+    // The tape is unbounded in both directions, so there is no "center" to start from.
+    loc = 0;
+    // initialize the current state of the turing machine tape head to the first enum state
+    curr_state = STATE_QA;
+    // Has no effect on program execution, since during the first iteration of the simulation this value will be overwritten
+    // to a new value based on a rule cell in the transition table.
+    curr_dir = LEFT;
+}
+
+// Move the tape head left or right one unit
+void tape_head::moveTapeHead()
+{
+    if (curr_dir == LEFT)
+        loc--;
+    else
+        loc++;
+}
+
+// Setter for the current state of the tape head
+void tape_head::setCurrentState(state s)
+{
+    curr_state = s;
+}
+
+// Setter for the current direction that the tape head
+// should move at the next iteration.
+void tape_head::setCurrentDirection(direction d)
+{
+    curr_dir = d;
+}
+
+// Setter for the tape head location:
+// Manually sets the tape head location.
+void tape_head::setTapeHeadLoc(long long l)
+{
+    loc = l;
+}
+
+// Getter for the tape head location
+long long tape_head::getTapeHeadLoc()
+{
+    return loc;
+}
+
+// Getter for the current direction
+direction tape_head::getCurrentDirection()
+{
+    return curr_dir;
+}
+
+// Getter for the current state of the tape head
+state tape_head::getCurrentState()
+{
+    return curr_state;
+}
+
+//
+// tape class implementation
+//
+
+// Bit tricks for the word-at-a-time scans: index of the lowest and highest set
+// bits of a non-zero word
+static inline int lowestBit(unsigned long long x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    for (; (x & 1) == 0; x >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+static inline int highestBit(unsigned long long x)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(x);
+#else
+    int n = 0;
+    for (; x > 1; x >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+tape::tape()
+{
+    format = TAPE_BYTES;
+    setupTape();
+}
+
+tape::tape(const tape &other)
+{
+    *this = other;
+}
+
+// Copying a tape copies its pages; the cached page pointer has to be
+// looked up again in the new copy.
+tape &tape::operator=(const tape &other)
+{
+    format = other.format;
+    right_pages = other.right_pages;
+    left_pages = other.left_pages;
+    cached_start = other.cached_start;
+    cached_page = findPage(cached_start, false);
+    for (int i = 0; i < NUMSYM; ++i)
+        symbol_counts[i] = other.symbol_counts[i];
+    return *this;
+}
+
+// Initalizes all tape cells to the zeroth
+// enum value for "symbol" (default start values)
+// When simulation is initialized, this method is called.
+// When simulation is reset, this method is called.
+// Only the page the tape head starts on is kept, everything else is released.
+void tape::setupTape()
+{
+    // (keeping the start page's memory, so that resetting a tape is cheap;
+    // BLANK is 0 in every format)
+    right_pages.resize(1);
+    right_pages[0].assign(wordsPerPage(), 0);
+    left_pages.clear();
+    cached_start = 0;
+    cached_page = &right_pages[0][0];
+    for (int i = 0; i < NUMSYM; ++i)
+        symbol_counts[i] = 0;
+    symbol_counts[BLANK] = TAPEPAGE;
+}
+
+// Switch the tape to another way of storing its cells, keeping its contents.
+// Switching to TAPE_BITS is only useful for a tape holding nothing but BLANK and
+// CROSS (anything else written later widens it to TAPE_PACKED).
+void tape::setFormat(tape_format new_format)
+{
+    if (new_format == format)
+        return;
+
+    // (the cells don't change, so neither do their counts)
+    long long counts[NUMSYM];
+    for (int i = 0; i < NUMSYM; ++i)
+        counts[i] = symbol_counts[i];
+
+    // read every allocated page out as one symbol per byte...
+    std::vector<unsigned char> cells;
+    std::vector<long long> starts;
+    for (int side = 0; side < 2; ++side)
+    {
+        std::vector<std::vector<unsigned long long> > &pages = side == 0 ? right_pages : left_pages;
+        for (size_t i = 0; i < pages.size(); ++i)
+        {
+            if (pages[i].empty())
+                continue;
+            long long start = side == 0 ? (long long)i * TAPEPAGE : -(long long)(i + 1) * TAPEPAGE;
+            findPage(start, false);
+            starts.push_back(start);
+            for (unsigned long long k = 0; k < TAPEPAGE; ++k)
+                cells.push_back((unsigned char)readCell(k));
+            pages[i].clear();
+        }
+    }
+
+    // ...and write them back in the new format
+    format = new_format;
+    if (new_format == TAPE_BITS)
+    {
+        for (size_t i = 0; i < cells.size(); ++i)
+            if (cells[i] > 1)
+                format = TAPE_PACKED;
+    }
+    for (size_t p = 0; p < starts.size(); ++p)
+    {
+        findPage(starts[p], true);
+        for (unsigned long long k = 0; k < TAPEPAGE; ++k)
+            writeCell(k, (symbol)cells[p * TAPEPAGE + k]);
+    }
+    findPage(0, true);
+    for (int i = 0; i < NUMSYM; ++i)
+        symbol_counts[i] = counts[i];
+}
+
+tape_format tape::getFormat()
+{
+    return format;
+}
+
+// Slow path for getTapeCell/setTapeCell: find the page holding a position
+// and make it the cached page. If the page doesn't exist yet it is allocated when
+// create is true, otherwise NULL is returned and the cached page is left as it was.
+unsigned long long *tape::findPage(long long position, bool create)
+{
+    // page number (rounding down for negative positions)
+    long long page_num = position >> TAPEPAGE_BITS;
+    std::vector<std::vector<unsigned long long> > &pages = page_num >= 0 ? right_pages : left_pages;
+    size_t index = (size_t)(page_num >= 0 ? page_num : -page_num - 1);
+
+    if (index >= pages.size() || pages[index].empty())
+    {
+        if (!create)
+            return NULL;
+        if (index >= pages.size())
+            pages.resize(index + 1);
+        pages[index].assign(wordsPerPage(), 0);
+        symbol_counts[BLANK] += TAPEPAGE;
+    }
+
+    cached_start = page_num * TAPEPAGE;
+    cached_page = &pages[index][0];
+    return cached_page;
+}
+
+// Number of cells held by one 64-bit word of a page
+int tape::cellsPerWord()
+{
+    switch (format)
+    {
+        case TAPE_BYTES:
+            return 8;
+        case TAPE_PACKED:
+            return PACKEDCELLS;
+        default:
+            return 64;
+    }
+}
+
+// Number of 64-bit words making up one page
+size_t tape::wordsPerPage()
+{
+    return (TAPEPAGE + cellsPerWord() - 1) / cellsPerWord();
+}
+
+// Number of cells actually allocated for the tape (a multiple of TAPEPAGE)
+long long tape::getAllocatedCells()
+{
+    long long pages = 0;
+    for (size_t i = 0; i < right_pages.size(); ++i)
+        pages += !right_pages[i].empty();
+    for (size_t i = 0; i < left_pages.size(); ++i)
+        pages += !left_pages[i].empty();
+    return pages * TAPEPAGE;
+}
+
+// Memory taken up by the allocated pages
+long long tape::getAllocatedBytes()
+{
+    return getAllocatedCells() / TAPEPAGE * (long long)(wordsPerPage() * sizeof(unsigned long long));
+}
+
+// First and last cell of the allocated pages (every cell that could be non-blank lies in between)
+void tape::getAllocatedRange(long long &first, long long &last)
+{
+    first = 0;
+    last = TAPEPAGE - 1;
+    for (size_t i = 0; i < right_pages.size(); ++i)
+        if (!right_pages[i].empty())
+            last = (long long)(i + 1) * TAPEPAGE - 1;
+    for (size_t i = 0; i < left_pages.size(); ++i)
+        if (!left_pages[i].empty())
+            first = -(long long)(i + 1) * TAPEPAGE;
+}
+
+// Raw cells of the page holding a position (allocating it if need be), for engines
+// that step through the tape directly. start is set to the position of the page's first cell.
+// Only a TAPE_BYTES tape has one byte per cell, so this is only meaningful in that format.
+// Cells written this way have to be counted with adjustCount().
+unsigned char *tape::getPage(long long position, long long &start)
+{
+    if ((unsigned long long)(position - cached_start) >= TAPEPAGE)
+        findPage(position, true);
+    start = cached_start;
+    return (unsigned char *)cached_page;
+}
+
+// Number of cells on the allocated pages holding a symbol
+// (every cell off the allocated pages is BLANK)
+long long tape::countSymbol(symbol sym)
+{
+    return symbol_counts[(int)sym];
+}
+
+// Number of cells holding a symbol other than BLANK
+long long tape::countNonBlank()
+{
+    long long count = 0;
+    for (int i = 0; i < NUMSYM; ++i)
+    {
+        if (i != BLANK)
+            count += symbol_counts[i];
+    }
+    return count;
+}
+
+// Add n cells to the count of a symbol (n < 0 takes them away), for engines that
+// write straight into the bytes of getPage() rather than through setTapeCell()
+void tape::adjustCount(symbol sym, long long n)
+{
+    symbol_counts[(int)sym] += n;
+}
+
+// Find the leftmost and rightmost non-blank cells, skipping blank words whole.
+// Returns false if the tape is blank.
+bool tape::findExtent(long long &first, long long &last)
+{
+    int bits = format == TAPE_BYTES ? 8 : format == TAPE_PACKED ? 3 : 1;
+    int per_word = cellsPerWord();
+    bool found = false;
+
+    // Pages in order from the left end of the tape to the right end
+    std::vector<std::pair<long long,const std::vector<unsigned long long> *> > order;
+    for (size_t i = left_pages.size(); i-- > 0; )
+        if (!left_pages[i].empty())
+            order.push_back(std::make_pair(-(long long)(i + 1) * TAPEPAGE, &left_pages[i]));
+    for (size_t i = 0; i < right_pages.size(); ++i)
+        if (!right_pages[i].empty())
+            order.push_back(std::make_pair((long long)i * TAPEPAGE, &right_pages[i]));
+
+    for (size_t p = 0; p < order.size() && !found; ++p)
+    {
+        const std::vector<unsigned long long> &words = *order[p].second;
+        for (size_t w = 0; w < words.size(); ++w)
+        {
+            if (words[w] == 0)
+                continue;
+            int cell;
+            if (format == TAPE_BYTES)
+                for (cell = 0; ((const unsigned char *)&words[w])[cell] == 0; ++cell);
+            else
+                cell = lowestBit(words[w]) / bits;
+            first = order[p].first + (long long)w * per_word + cell;
+            found = true;
+            break;
+        }
+    }
+
+    if (!found)
+        return false;
+
+    for (size_t p = order.size(); p-- > 0; )
+    {
+        const std::vector<unsigned long long> &words = *order[p].second;
+        for (size_t w = words.size(); w-- > 0; )
+        {
+            if (words[w] == 0)
+                continue;
+            int cell;
+            if (format == TAPE_BYTES)
+                for (cell = 7; ((const unsigned char *)&words[w])[cell] == 0; --cell);
+            else
+                cell = highestBit(words[w]) / bits;
+            last = order[p].first + (long long)w * per_word + cell;
+            return true;
+        }
+    }
+
+    return true;
+}
+
+// The count cells from a position (count is at most cellsPerWord()), packed into one word
+// the way this tape packs them. Two tapes in the same format give equal words exactly
+// when the cells are equal.
+unsigned long long tape::readCells(long long position, int count)
+{
+    int bits = format == TAPE_BYTES ? 8 : format == TAPE_PACKED ? 3 : 1;
+    unsigned long long mask = count * bits >= 64 ? ~0ULL : (1ULL << (count * bits)) - 1;
+    unsigned long long value = 0;
+
+    unsigned long long offset = (unsigned long long)(position - cached_start);
+    if (offset >= TAPEPAGE)
+    {
+        if (findPage(position, false) != NULL)
+            offset = (unsigned long long)(position - cached_start);
+    }
+
+    if (offset < TAPEPAGE && offset + count <= TAPEPAGE)
+    {
+        // all on one page: shift the cells out of (at most) two words
+        if (format == TAPE_BYTES)
+        {
+            memcpy(&value, (unsigned char *)cached_page + offset, count);
+            return value;
+        }
+        int per_word = cellsPerWord();
+        size_t w = (size_t)(offset / per_word);
+        int shift = (int)(offset % per_word) * bits;
+        int used = per_word * bits;
+        value = cached_page[w] >> shift;
+        if (shift > 0 && shift + count * bits > used)
+            value |= cached_page[w + 1] << (used - shift);
+        return value & mask;
+    }
+
+    // straddling pages, or off the allocated pages
+    for (int k = 0; k < count; ++k)
+        value |= (unsigned long long)getTapeCell(position + k) << (k * bits);
+    return value;
+}
+
+// True if length cells from position a on this tape are the same as those from
+// position b on another tape
+bool tape::equalWindow(long long a, tape &other, long long b, long long length)
+{
+    if (other.format != format)
+    {
+        for (long long k = 0; k < length; ++k)
+            if (getTapeCell(a + k) != other.getTapeCell(b + k))
+                return false;
+        return true;
+    }
+
+    int per_word = cellsPerWord();
+    for (long long k = 0; k < length; k += per_word)
+    {
+        int count = length - k < per_word ? (int)(length - k) : per_word;
+        if (readCells(a + k, count) != other.readCells(b + k, count))
+            return false;
+    }
+    return true;
+}
+
+//
+// headless engine class implementation
+//
+
+tm_engine::tm_engine()
+{
+    th_obj = tape_head();
+    tracer = NULL;
+    setupTransitionTable(false);
+    reset();
+}
+
+// Put the machine back at the start of a run: blank tape, tape head in the
+// middle of the tape in the first state. The rule-set is left untouched.
+void tm_engine::reset()
+{
+    // simulation not running
+    halt = false;
+    // number of ticks for current simulation
+    ticks = 0;
+    // set current tape head state to first (default) state
+    th_obj.setCurrentState(STATE_QA);
+    // set current tape head direction to left (default)
+    th_obj.setCurrentDirection(LEFT);
+    halt_rule_state = STATE_QA;
+    halt_rule_symbol = BLANK;
+    // set machine head to cell 0
+    th_obj.setTapeHeadLoc(0);
+    span_min = span_max = 0;
+    // no rule has been used yet
+    for (int i = 0; i < NUMSTT * NUMSYM; ++i)
+        rule_hits[i] = 0;
+    for (int i = 0; i < NUMSTT; ++i)
+        state_ticks[i] = 0;
+    // initialize tape
+    tape_obj.setupTape();
+}
+
+// initialize the rule-set
+// To start all combinations of states and symbols should yield:
+// goto state a, print symbol . on tape, move left
+void tm_engine::setupTransitionTable(bool rnd)
+{
+    setupTransitionTable(rnd, NUMSTT, NUMSYM);
+}
+
+// The same, with random rules only for the first states and symbols: the rest stay at
+// a/./left, and the random rules only go to those states (or halt) and write those symbols
+void tm_engine::setupTransitionTable(bool rnd, int states, int symbols)
+{
+    compiled = false;
+
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            // if i == 3 and j == 5, for instance, then
+            // state "c" and symbol "1" on the transition table should produce
+            // a/./left (as should every other combination to start out)
+            bool random_rule = rnd && i < states && j < symbols;
+            ruleset[i][j].curr_state = (state)i;
+            ruleset[i][j].curr_symbol = (symbol)j;
+            if (random_rule)
+            {
+                // the last 3 choices are the halting states
+                int next = rand() % (states + 3);
+                ruleset[i][j].next_state = (state)(next < states ? next : NUMSTT + next - states);
+            }
+            else
+            {
+                ruleset[i][j].next_state = (state)0;
+            }
+            ruleset[i][j].write_symbol = (random_rule == false ? (symbol)0 : (symbol)(rand() % symbols));
+            ruleset[i][j].move_head = (random_rule == false ? (direction)0 : (direction)(rand() % 2));
+        }
+    }
+}
+
+// Read a rule-set in its text form.
+// Each state is a row of rules separated by '_', and each rule is written the way the
+// transition table displays it: next state, symbol to write, direction.
+// i.e. "bXrHXl_aXlbXr" is a 2 state, 2 symbol machine.
+// Rules not mentioned in the text are set to the default a/./left.
+// Returns false (leaving the rule-set at its defaults) if the text is malformed.
+bool tm_engine::parseRuleset(const std::string &text)
+{
+    // (this also marks the rule-set as changed)
+    setupTransitionTable(false);
+
+    int row = 0;
+    int col = 0;
+    size_t i = 0;
+
+    while (i < text.size())
+    {
+        if (text[i] == '_')
+        {
+            row++;
+            col = 0;
+            i++;
+            continue;
+        }
+
+        if (row >= NUMSTT || col >= NUMSYM || i + 3 > text.size())
+        {
+            setupTransitionTable(false);
+            return false;
+        }
+
+        int s = -1, y = -1, d = -1;
+        for (int k = 0; k < NUMSTT + 3; ++k)
+            if (state_char[k] == text[i])
+                s = k;
+        for (int k = 0; k < NUMSYM; ++k)
+            if (symbol_char[k] == text[i + 1])
+                y = k;
+        for (int k = 0; k < 2; ++k)
+            if (dir_char[k] == text[i + 2])
+                d = k;
+
+        if (s < 0 || y < 0 || d < 0)
+        {
+            setupTransitionTable(false);
+            return false;
+        }
+
+        ruleset[row][col].next_state = (state)s;
+        ruleset[row][col].write_symbol = (symbol)y;
+        ruleset[row][col].move_head = (direction)d;
+
+        col++;
+        i += 3;
+    }
+
+    return true;
+}
+
+// Write the first num_states x num_symbols rules in the text form read by parseRuleset
+std::string tm_engine::rulesetString(int num_states, int num_symbols)
+{
+    std::string text;
+
+    for (int i = 0; i < num_states; ++i)
+    {
+        if (i > 0)
+            text += '_';
+        for (int j = 0; j < num_symbols; ++j)
+        {
+            text += state_char[(int)ruleset[i][j].next_state];
+            text += symbol_char[(int)ruleset[i][j].write_symbol];
+            text += dir_char[(int)ruleset[i][j].move_head];
+        }
+    }
+
+    return text;
+}
+
+// apply one step of the transition table rule-set onto the TM
+void tm_engine::applyTransition()
+{
+    // What is the index of the tape cell that the tape head is currently located at?
+    long long tape_head_loc = th_obj.getTapeHeadLoc();
+
+    // What is the current symbol of the tape cell above the tape head?
+    symbol current_symbol = tape_obj.getTapeCell(tape_head_loc);
+
+    // What is the current state of the tape head?
+    state current_state = th_obj.getCurrentState();
+
+    // record the step before it changes anything
+    if (tracer != NULL)
+        tracer->record(*this, current_symbol, ruleset[(int)current_state][(int)current_symbol]);
+    rule_hits[(int)current_state * NUMSYM + (int)current_symbol]++;
+
+    // Set the current state of the tape head based on current_symbol and current_state
+    th_obj.setCurrentState(ruleset[(int)current_state][(int)current_symbol].next_state);
+
+    // The tape head is in a non-halting state...
+    if (th_obj.getCurrentState() != STATE_QACCEPT && th_obj.getCurrentState() != STATE_QREJECT && th_obj.getCurrentState() != STATE_QHALT)
+    {
+        // then set the tape head's next direction
+        th_obj.setCurrentDirection(ruleset[(int)current_state][(int)current_symbol].move_head);
+        // (a tick spent in current_state)
+        state_ticks[(int)current_state]++;
+        // and set the tape cell's next symbol value
+        tape_obj.setTapeCell(ruleset[(int)current_state][(int)current_symbol].write_symbol,tape_head_loc);
+    }
+    else
+    {
+        // otherwise the current simulation run should come to an end (as signified by this flag)
+        halt = true;
+        // remember which rule halted the machine
+        halt_rule_state = current_state;
+        halt_rule_symbol = current_symbol;
+    }
+}
+
+// Second half of a tick: move the tape head left or right depending on the ruleset
+// and current states, and count the tick.
+void tm_engine::advance()
+{
+    th_obj.moveTapeHead();
+
+    long long loc = th_obj.getTapeHeadLoc();
+    if (loc < span_min)
+        span_min = loc;
+    if (loc > span_max)
+        span_max = loc;
+
+    ticks++;
+}
+
+// One full simulation tick. Returns false once the machine has halted.
+bool tm_engine::step()
+{
+    if (halt)
+        return false;
+
+    applyTransition();
+
+    // A halting transition doesn't move the tape head or count as a tick
+    if (halt)
+        return false;
+
+    advance();
+    return true;
+}
+
+// Flatten the rule-set into the table used by run(), so that a step is a single table
+// lookup with no getters, setters or separate checks for the three halting states.
+void tm_engine::compile()
+{
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            const transition &rule = ruleset[i][j];
+            compiled_rule &c = program[i * NUMSYM + j];
+
+            c.halts = isHaltingState(rule.next_state);
+            c.next = (unsigned char)(c.halts ? (int)rule.next_state : (int)rule.next_state * NUMSYM);
+            c.write = (unsigned char)rule.write_symbol;
+            c.move = rule.move_head == LEFT ? -1 : 1;
+        }
+    }
+
+    compiled = true;
+}
+
+// Run the machine with no display until it halts or max_steps more ticks have passed.
+// This gives exactly the same result as calling step() max_steps times, but runs from
+// the compiled rule-set directly on the tape's pages.
+run_result tm_engine::run(long long max_steps)
+{
+    if (halt || max_steps <= 0)
+        return getResult();
+
+    if (!compiled)
+        compile();
+
+    // a traced machine has to go through applyTransition() for every step
+    if (tracer != NULL)
+    {
+        for (long long n = 0; n < max_steps && step(); ++n);
+        return getResult();
+    }
+
+    // stepping a pointer through the page needs one byte per cell
+    if (tape_obj.getFormat() != TAPE_BYTES)
+        return runCells(max_steps);
+
+    long long position = th_obj.getTapeHeadLoc();
+    long long lo = span_min;
+    long long hi = span_max;
+    size_t current = (size_t)th_obj.getCurrentState() * NUMSYM;
+    long long hits_before[NUMSTT * NUMSYM];
+    memcpy(hits_before, rule_hits, sizeof(rule_hits));
+    long long page_start;
+    unsigned char *page = tape_obj.getPage(position, page_start);
+    // the tape head is tracked as a pointer into the page (and the position worked
+    // out from it), which keeps the chain of dependent work per step short
+    unsigned char *cell = page + (position - page_start);
+    const compiled_rule *rule = NULL;
+    long long n = 0;
+
+    while (n < max_steps)
+    {
+        rule = &program[current + *cell];
+        rule_hits[current + *cell]++;
+
+        if (rule->halts)
+        {
+            // a halting rule doesn't write, move or count as a tick
+            halt = true;
+            halt_rule_state = (state)(current / NUMSYM);
+            halt_rule_symbol = (symbol)*cell;
+            break;
+        }
+
+        *cell = rule->write;
+        cell += rule->move;
+        current = rule->next;
+        n++;
+
+        unsigned long long offset = (unsigned long long)(cell - page);
+        position = page_start + (long long)offset;
+        lo = position < lo ? position : lo;
+        hi = position > hi ? position : hi;
+
+        // the tape head has moved off the page
+        if (offset >= TAPEPAGE)
+        {
+            page = tape_obj.getPage(position, page_start);
+            cell = page + (position - page_start);
+        }
+    }
+
+    th_obj.setTapeHeadLoc(position);
+    th_obj.setCurrentState(halt ? (state)rule->next : (state)(current / NUMSYM));
+    if (n > 0 && !halt)
+        th_obj.setCurrentDirection(rule->move < 0 ? LEFT : RIGHT);
+    span_min = lo;
+    span_max = hi;
+    ticks += n;
+    countHits(hits_before);
+
+    return getResult();
+}
+
+// Bring the tape's symbol counts and the ticks per state up to date after run() has
+// taken steps without counting them: every use of a (non-halting) rule since the hit
+// counts were hits_before was a tick in its state, and turned a cell holding the
+// symbol it reads into one holding the symbol it writes
+void tm_engine::countHits(const long long *hits_before)
+{
+    for (int i = 0; i < NUMSTT * NUMSYM; ++i)
+    {
+        long long n = rule_hits[i] - hits_before[i];
+        if (n == 0 || program[i].halts)
+            continue;
+        state_ticks[i / NUMSYM] += n;
+        tape_obj.adjustCount((symbol)(i % NUMSYM), -n);
+        tape_obj.adjustCount((symbol)program[i].write, n);
+    }
+}
+
+// run() for tapes not stored one byte per cell: the same loop over the compiled
+// rule-set, reading and writing the tape a cell at a time
+run_result tm_engine::runCells(long long max_steps)
+{
+    long long position = th_obj.getTapeHeadLoc();
+    long long lo = span_min;
+    long long hi = span_max;
+    size_t current = (size_t)th_obj.getCurrentState() * NUMSYM;
+    long long hits_before[NUMSTT * NUMSYM];
+    memcpy(hits_before, rule_hits, sizeof(rule_hits));
+    const compiled_rule *rule = NULL;
+    long long n = 0;
+
+    while (n < max_steps)
+    {
+        symbol read = tape_obj.getTapeCell(position);
+        rule = &program[current + read];
+        rule_hits[current + read]++;
+
+        if (rule->halts)
+        {
+            halt = true;
+            halt_rule_state = (state)(current / NUMSYM);
+            halt_rule_symbol = read;
+            break;
+        }
+
+        tape_obj.overwriteCell((symbol)rule->write, position);
+        position += rule->move;
+        current = rule->next;
+        n++;
+
+        lo = position < lo ? position : lo;
+        hi = position > hi ? position : hi;
+    }
+
+    th_obj.setTapeHeadLoc(position);
+    th_obj.setCurrentState(halt ? (state)rule->next : (state)(current / NUMSYM));
+    if (n > 0 && !halt)
+        th_obj.setCurrentDirection(rule->move < 0 ? LEFT : RIGHT);
+    span_min = lo;
+    span_max = hi;
+    ticks += n;
+    countHits(hits_before);
+
+    return getResult();
+}
+
+// Summary of the run so far
+run_result tm_engine::getResult()
+{
+    run_result result;
+    result.ticks = ticks;
+    result.final_state = th_obj.getCurrentState();
+    result.halted = halt;
+    result.tape_min = span_min;
+    result.tape_max = span_max;
+    result.non_blank = tape_obj.countNonBlank();
+    result.halt_rule_state = halt_rule_state;
+    result.halt_rule_symbol = halt_rule_symbol;
+    return result;
+}
+
+// Getter for a rule in the rule-set
+const transition &tm_engine::getRule(int state_int, int symbol_int)
+{
+    return ruleset[state_int][symbol_int];
+}
+
+// Setter for a rule in the rule-set (the current state and symbol of the rule
+// are kept). The compiled rule-set is re-derived on the next run().
+void tm_engine::setRule(int state_int, int symbol_int, const transition &rule)
+{
+    ruleset[state_int][symbol_int].next_state = rule.next_state;
+    ruleset[state_int][symbol_int].write_symbol = rule.write_symbol;
+    ruleset[state_int][symbol_int].move_head = rule.move_head;
+    compiled = false;
+}
+
+tape_head &tm_engine::getTapeHead()
+{
+    return th_obj;
+}
+
+tape &tm_engine::getTape()
+{
+    return tape_obj;
+}
+
+bool tm_engine::isHalted()
+{
+    return halt;
+}
+
+long long tm_engine::getTicks()
+{
+    return ticks;
+}
+
+// Setters used by engines that advance the machine by more than one tick at a time
+// (the tape head and tape are updated through getTapeHead() and getTape())
+void tm_engine::setHalted(bool h)
+{
+    halt = h;
+}
+
+void tm_engine::setTicks(long long t)
+{
+    ticks = t;
+}
+
+// Setter for the rule that took the machine to a halting state
+void tm_engine::setHaltRule(state s, symbol y)
+{
+    halt_rule_state = s;
+    halt_rule_symbol = y;
+}
+
+// Record that the tape head has been above every cell from lo to hi
+void tm_engine::extendSpan(long long lo, long long hi)
+{
+    if (lo < span_min)
+        span_min = lo;
+    if (hi > span_max)
+        span_max = hi;
+}
+
+// Setter for the leftmost and rightmost tape head locations (for undoing steps)
+void tm_engine::setSpan(long long lo, long long hi)
+{
+    span_min = lo;
+    span_max = hi;
+}
+
+// Record every step from now on with a trace writer (NULL to stop)
+void tm_engine::setTracer(trace_writer *t)
+{
+    tracer = t;
+}
+
+// The trace writer recording every step (NULL when not tracing)
+trace_writer *tm_engine::getTracer()
+{
+    return tracer;
+}
+
+// Number of times a rule has been applied since the last reset (halting rules included)
+long long tm_engine::getHits(int state_int, int symbol_int)
+{
+    return rule_hits[state_int * NUMSYM + symbol_int];
+}
+
+// Number of ticks spent in a state since the last reset
+long long tm_engine::getStateTicks(int state_int)
+{
+    return state_ticks[state_int];
+}
+
+// Count a rule as applied n more times (for engines that apply a rule many times at
+// once, or undo steps). The macro engine doesn't keep the counts. The ticks these
+// were are counted with addStateTicks().
+void tm_engine::addHits(int state_int, int symbol_int, long long n)
+{
+    rule_hits[state_int * NUMSYM + symbol_int] += n;
+}
+
+// Count n more ticks spent in a state (alongside addHits(), for the hits of rules
+// that don't halt)
+void tm_engine::addStateTicks(int state_int, long long n)
+{
+    state_ticks[state_int] += n;
+}
+
+// The hit counts of the first num_states x num_symbols rules as CSV, one rule per line
+std::string tm_engine::hitsCSV(int num_states, int num_symbols)
+{
+    std::string text = "state,symbol,next_state,write_symbol,direction,hits\n";
+    char line[96];
+
+    for (int i = 0; i < num_states; ++i)
+    {
+        for (int j = 0; j < num_symbols; ++j)
+        {
+            const transition &rule = ruleset[i][j];
+            snprintf(line, sizeof(line), "%c,%c,%c,%c,%c,%lld\n",
+                     state_char[i], symbol_char[j], state_char[(int)rule.next_state],
+                     symbol_char[(int)rule.write_symbol], dir_char[(int)rule.move_head],
+                     rule_hits[i * NUMSYM + j]);
+            text += line;
+        }
+    }
+
+    return text;
+}
@@ -0,0 +1,326 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+// The stepping core of the Turing machine. Nothing in here depends on
+// curses, so it can be driven either by the interactive display (sim_obj)
+// or headless from the command line.
+
+#include <string>
+#include <vector>
+
+// Number of cells in one page of the tape (4096).
+// The tape grows in both directions one page at a time.
+#define TAPEPAGE_BITS 12
+#define TAPEPAGE (1 << TAPEPAGE_BITS)
+
+// There are 6*16 possible rules
+#define NUMSYM 6
+#define NUMSTT 16 // num non halting states
+
+// Direction the TM tape head will go
+enum direction
+{
+	LEFT,RIGHT
+};
+
+// A TM tape symbol
+enum symbol
+{
+	BLANK, CROSS, ASTERISK, AMPERSAND, ZERO, ONE
+};
+
+// A TM tape state (3 are halting states)
+enum state
+{
+	STATE_QA, STATE_QB, STATE_QC, STATE_QD,
+	STATE_QE, STATE_QF, STATE_QG, STATE_QH,
+	STATE_QI, STATE_QJ, STATE_QK, STATE_QL,
+	STATE_QM, STATE_QN, STATE_QO, STATE_QP,
+	STATE_QHALT,
+	STATE_QACCEPT, STATE_QREJECT
+};
+
+// Plain characters for a state, symbol and direction.
+// These match the characters drawn by the curses display, and are
+// used for the text form of a rule-set and for headless output.
+static const char state_char[NUMSTT + 3] =
+{
+	'a','b','c','d','e','f','g','h',
+	'i','j','k','l','m','n','o','p',
+	'H','A','R'
+};
+
+static const char symbol_char[NUMSYM] =
+{
+	'.','X','$','&','0','1'
+};
+
+static const char dir_char[2] =
+{
+	'l','r'
+};
+
+// True for STATE_QHALT, STATE_QACCEPT and STATE_QREJECT
+inline bool isHaltingState(state s)
+{
+    return (int)s >= NUMSTT;
+}
+
+// Represents a transition for a rule in the modifiable rule-set
+// of a TM
+struct transition
+{
+    state next_state;
+    symbol write_symbol;
+    direction move_head;
+    state curr_state;
+    symbol curr_symbol;
+};
+
+class tape_head
+{
+    public:
+        tape_head();
+        void moveTapeHead();
+        void setCurrentDirection(direction);
+        void setCurrentState(state);
+        void setTapeHeadLoc(long long);
+        long long getTapeHeadLoc();
+        direction getCurrentDirection();
+        state getCurrentState();
+    private:
+        long long loc;
+        direction curr_dir;
+        state curr_state;
+};
+
+// How a tape stores its cells
+enum tape_format
+{
+	TAPE_BYTES,   // one byte per cell (the fastest to step through)
+	TAPE_PACKED,  // 3 bits per cell, 21 cells to a 64-bit word
+	TAPE_BITS     // 1 bit per cell, for machines that only use BLANK and CROSS
+	              // (a tape is widened to TAPE_PACKED if anything else is written)
+};
+
+// Cells in one 64-bit word of a TAPE_PACKED page
+#define PACKEDCELLS 21
+
+// An unbounded tape, made of pages of TAPEPAGE cells that are only allocated
+// once a cell on them is written to. Cell 0 is where the tape head starts.
+// Pages are kept as 64-bit words in any format, so the scans below (finding the
+// written extent, comparing windows) work a word at a time. The number of cells
+// holding each symbol is kept up to date as cells are written, so counting
+// symbols needs no scan at all.
+class tape
+{
+    public:
+        tape();
+        tape(const tape &);
+        tape &operator=(const tape &);
+        void setupTape();
+        void setFormat(tape_format);
+        tape_format getFormat();
+        void setTapeCell(symbol,long long);
+        void overwriteCell(symbol,long long);
+        symbol getTapeCell(long long);
+        long long getAllocatedCells();
+        long long getAllocatedBytes();
+        void getAllocatedRange(long long &,long long &);
+        unsigned char *getPage(long long,long long &);
+        long long countSymbol(symbol);
+        long long countNonBlank();
+        void adjustCount(symbol,long long);
+        bool findExtent(long long &,long long &);
+        bool equalWindow(long long,tape &,long long,long long);
+    private:
+        unsigned long long *findPage(long long,bool);
+        symbol readCell(unsigned long long);
+        void writeCell(unsigned long long,symbol);
+        unsigned long long readCells(long long,int);
+        int cellsPerWord();
+        size_t wordsPerPage();
+        tape_format format;
+        // pages holding cells 0, 1, 2... and cells -1, -2, -3...
+        // (an empty vector is a page that has never been written to)
+        std::vector<std::vector<unsigned long long> > right_pages;
+        std::vector<std::vector<unsigned long long> > left_pages;
+        // The page most recently accessed, so that a tape head staying on
+        // one page doesn't have to look it up again
+        long long cached_start;
+        unsigned long long *cached_page;
+        // number of cells on the allocated pages holding each symbol
+        long long symbol_counts[NUMSYM];
+};
+
+// Getter for a tape cell at a given position.
+// Cells that have never been written to are blank.
+inline symbol tape::getTapeCell(long long position)
+{
+    if ((unsigned long long)(position - cached_start) >= TAPEPAGE && findPage(position, false) == NULL)
+        return BLANK;
+    return readCell((unsigned long long)(position - cached_start));
+}
+
+// Setter for a tape cell at a given position.
+inline void tape::setTapeCell(symbol new_val, long long position)
+{
+    if ((unsigned long long)(position - cached_start) >= TAPEPAGE)
+        findPage(position, true);
+    unsigned long long offset = (unsigned long long)(position - cached_start);
+    symbol_counts[(int)readCell(offset)]--;
+    symbol_counts[(int)new_val]++;
+    writeCell(offset, new_val);
+}
+
+// setTapeCell() without keeping the symbol counts up to date, for engines that
+// bring them up to date themselves (with adjustCount())
+inline void tape::overwriteCell(symbol new_val, long long position)
+{
+    if ((unsigned long long)(position - cached_start) >= TAPEPAGE)
+        findPage(position, true);
+    writeCell((unsigned long long)(position - cached_start), new_val);
+}
+
+// Cell at an offset into the cached page
+inline symbol tape::readCell(unsigned long long offset)
+{
+    switch (format)
+    {
+        case TAPE_BYTES:
+            return (symbol)((unsigned char *)cached_page)[offset];
+        case TAPE_PACKED:
+            return (symbol)((cached_page[offset / PACKEDCELLS] >> (offset % PACKEDCELLS * 3)) & 7);
+        default:
+            return (symbol)((cached_page[offset >> 6] >> (offset & 63)) & 1);
+    }
+}
+
+// Set the cell at an offset into the cached page
+inline void tape::writeCell(unsigned long long offset, symbol new_val)
+{
+    if (format == TAPE_BYTES)
+    {
+        ((unsigned char *)cached_page)[offset] = (unsigned char)new_val;
+    }
+    else if (format == TAPE_PACKED)
+    {
+        unsigned long long &word = cached_page[offset / PACKEDCELLS];
+        int shift = (int)(offset % PACKEDCELLS) * 3;
+        word = (word & ~(7ULL << shift)) | ((unsigned long long)new_val << shift);
+    }
+    else if ((int)new_val <= 1)
+    {
+        unsigned long long &word = cached_page[offset >> 6];
+        word = (word & ~(1ULL << (offset & 63))) | ((unsigned long long)new_val << (offset & 63));
+    }
+    else
+    {
+        // a symbol one bit can't hold: widen the whole tape first
+        long long position = cached_start + (long long)offset;
+        setFormat(TAPE_PACKED);
+        findPage(position, true);
+        writeCell((unsigned long long)(position - cached_start), new_val);
+    }
+}
+
+// One rule of a compiled rule-set (see tm_engine::compile())
+struct compiled_rule
+{
+    // where the next state's rules start in the compiled rule-set (state * NUMSYM),
+    // or the halting state itself for a halting rule
+    unsigned char next;
+    // symbol to write
+    unsigned char write;
+    // -1 (left) or 1 (right)
+    signed char move;
+    // non-zero if the rule takes the machine to a halting state
+    unsigned char halts;
+};
+
+// Summary of a (headless) run of the machine
+struct run_result
+{
+    // number of ticks the machine has executed in total
+    long long ticks;
+    // state the tape head ended up in
+    state final_state;
+    // true if a halting state was reached
+    bool halted;
+    // leftmost and rightmost tape cells the tape head has been above
+    long long tape_min;
+    long long tape_max;
+    // number of cells holding a symbol other than BLANK
+    long long non_blank;
+    // the rule (state and symbol read) that took the machine to a halting state
+    state halt_rule_state;
+    symbol halt_rule_symbol;
+};
+
+class trace_writer;
+
+// The render-free Turing machine: tape head, tape, rule-set and halting logic.
+class tm_engine
+{
+    public:
+        tm_engine();
+        void reset();
+        void setupTransitionTable(bool);
+        void setupTransitionTable(bool,int,int);
+        bool parseRuleset(const std::string &);
+        std::string rulesetString(int,int);
+        void applyTransition();
+        void advance();
+        bool step();
+        run_result run(long long);
+        run_result getResult();
+        const transition &getRule(int,int);
+        void setRule(int,int,const transition &);
+        tape_head &getTapeHead();
+        tape &getTape();
+        bool isHalted();
+        long long getTicks();
+        void setHalted(bool);
+        void setTicks(long long);
+        void setHaltRule(state,symbol);
+        void extendSpan(long long,long long);
+        void setSpan(long long,long long);
+        void setTracer(trace_writer *);
+        trace_writer *getTracer();
+        long long getHits(int,int);
+        long long getStateTicks(int);
+        void addHits(int,int,long long);
+        void addStateTicks(int,long long);
+        std::string hitsCSV(int,int);
+    private:
+        void compile();
+        void countHits(const long long *);
+        run_result runCells(long long);
+        tape_head th_obj;
+        tape tape_obj;
+        // Instance of an 2d array of rules representing A TM
+        transition ruleset[NUMSTT][NUMSYM];
+        // The rule-set flattened into a table indexed by state * NUMSYM + symbol,
+        // for run(). It is re-derived whenever the rule-set has changed.
+        compiled_rule program[NUMSTT * NUMSYM];
+        bool compiled;
+        bool halt;
+        long long ticks;
+        // leftmost and rightmost tape head locations since the last reset
+        long long span_min;
+        long long span_max;
+        // the rule that took the machine to a halting state
+        state halt_rule_state;
+        symbol halt_rule_symbol;
+        // where every step is recorded (NULL when not tracing)
+        trace_writer *tracer;
+        // number of times each rule has been applied since the last reset, indexed
+        // like program (state * NUMSYM + symbol)
+        long long rule_hits[NUMSTT * NUMSYM];
+        // ticks spent in each state since the last reset, counted as the ticks are
+        // taken (so editing a rule between halting and non-halting later doesn't
+        // change them)
+        long long state_ticks[NUMSTT];
+};
+
+#endif
@@ -0,0 +1,362 @@
+#include "hashlife.h"
+#include <algorithm>
+
+hashlife_engine::hashlife_engine(tm_engine &m) : machine(m)
+{
+    for (int i = 0; i < NUMSYM; ++i)
+    {
+        hash_node leaf = {-1, -1, 0};
+        nodes.push_back(leaf);
+    }
+    empties.push_back((int)BLANK);
+    node_limit = HASHNODES;
+}
+
+// Number of nodes made so far
+long long hashlife_engine::getNodeCount()
+{
+    return (long long)nodes.size();
+}
+
+// Number of runs remembered so far
+long long hashlife_engine::getCacheSize()
+{
+    return (long long)cache.size();
+}
+
+// The node made of two halves (of the same level), made on first use
+int hashlife_engine::join(int left, int right)
+{
+    unsigned long long key = (unsigned long long)left << 32 | (unsigned int)right;
+
+    std::unordered_map<unsigned long long,int>::iterator it = interned.find(key);
+    if (it != interned.end())
+        return it->second;
+
+    hash_node n = {left, right, nodes[left].level + 1};
+    nodes.push_back(n);
+    return interned[key] = (int)nodes.size() - 1;
+}
+
+// The node of a level whose cells are all blank
+int hashlife_engine::empty(int level)
+{
+    while ((int)empties.size() <= level)
+        empties.push_back(join(empties.back(), empties.back()));
+    return empties[level];
+}
+
+// The node of a level for the machine's tape from start on (everything outside first
+// .. last being blank)
+int hashlife_engine::build(int level, long long start, long long first, long long last)
+{
+    long long size = 1LL << level;
+    if (start > last || start + size - 1 < first)
+        return empty(level);
+    if (level == 0)
+        return (int)machine.getTape().getTapeCell(start);
+
+    int left = build(level - 1, start, first, last);
+    int right = build(level - 1, start + size / 2, first, last);
+    return join(left, right);
+}
+
+// Write a node back onto the machine's tape from start on. Blank nodes are skipped
+// outside first .. last (what was on the tape before the run).
+void hashlife_engine::store(int node, long long start, long long first, long long last)
+{
+    int level = nodes[node].level;
+    long long size = 1LL << level;
+    if (node == empty(level) && (start > last || start + size - 1 < first))
+        return;
+
+    if (level == 0)
+    {
+        // don't allocate tape pages just to write blanks on them
+        tape &t = machine.getTape();
+        if (t.getTapeCell(start) != (symbol)node)
+            t.setTapeCell((symbol)node, start);
+        return;
+    }
+    store(nodes[node].left, start, first, last);
+    store(nodes[node].right, start + size / 2, first, last);
+}
+
+// Copy a node (and everything under it) into a new node table
+int hashlife_engine::copyNode(int node, std::vector<hash_node> &fresh, std::unordered_map<int,int> &copied)
+{
+    if (node < NUMSYM)
+        return node;
+
+    std::unordered_map<int,int>::iterator it = copied.find(node);
+    if (it != copied.end())
+        return it->second;
+
+    hash_node n = nodes[node];
+    n.left = copyNode(n.left, fresh, copied);
+    n.right = copyNode(n.right, fresh, copied);
+    fresh.push_back(n);
+    int id = (int)fresh.size() - 1;
+    interned[(unsigned long long)n.left << 32 | (unsigned int)n.right] = id;
+    return copied[node] = id;
+}
+
+// Throw away every node that isn't part of the tape (root), and the runs remembered
+// for them. Returns the root's new id.
+int hashlife_engine::compact(int root)
+{
+    std::vector<hash_node> fresh(nodes.begin(), nodes.begin() + NUMSYM);
+    std::unordered_map<int,int> copied;
+
+    interned.clear();
+    root = copyNode(root, fresh, copied);
+    nodes.swap(fresh);
+    empties.resize(1);
+    cache.clear();
+
+    // (if most of the nodes are in use, wait until there are twice as many)
+    node_limit = std::max((size_t)HASHNODES, 2 * nodes.size());
+    return root;
+}
+
+// One step of the machine on a leaf. entered is true if the tape head moved onto it.
+hash_run hashlife_engine::step(int node, state s, bool entered, long long max_steps)
+{
+    hash_run r;
+    r.node = node;
+    r.exit = HASH_STOPPED;
+    r.new_state = r.halt_from = s;
+    r.last_move = 0;
+    r.ticks = 0;
+    r.offset = 0;
+    r.min_offset = entered ? 0 : 1;
+    r.max_offset = 0;
+
+    if (max_steps <= 0)
+        return r;
+
+    const transition &rule = machine.getRule((int)s, node);
+    r.new_state = rule.next_state;
+
+    // a halting transition doesn't write, move or count as a tick
+    if (isHaltingState(rule.next_state))
+    {
+        r.exit = HASH_HALTED;
+        return r;
+    }
+
+    r.node = (int)rule.write_symbol;
+    r.last_move = rule.move_head == LEFT ? -1 : 1;
+    r.exit = rule.move_head == LEFT ? HASH_LEFT : HASH_RIGHT;
+    r.offset = r.last_move;
+    r.ticks = 1;
+    return r;
+}
+
+// Run the machine inside a node until the tape head leaves it, it halts or max_steps
+// ticks have passed, with the tape head starting at offset (moved there if entered)
+hash_run hashlife_engine::runFrom(int node, state s, long long offset, bool entered, long long max_steps)
+{
+    int level = nodes[node].level;
+    if (level == 0)
+        return step(node, s, entered, max_steps);
+    if (entered && offset == 0)
+        return enter(node, s, 0, max_steps);
+    if (entered && offset == (1LL << level) - 1)
+        return enter(node, s, 1, max_steps);
+    return descend(node, s, offset, entered, max_steps);
+}
+
+// Run the machine inside a node entered at its left (side 0) or right (side 1) end,
+// remembering the result once it is known to have left the node or halted
+hash_run hashlife_engine::enter(int node, state s, int side, long long max_steps)
+{
+    unsigned long long key = ((unsigned long long)node * NUMSTT + (unsigned long long)s) * 2 + side;
+
+    std::unordered_map<unsigned long long,hash_run>::iterator it = cache.find(key);
+    if (it != cache.end())
+    {
+        // (a halting rule is only read with a tick to spare)
+        const hash_run &known = it->second;
+        if (known.ticks < max_steps || (known.ticks == max_steps && known.exit != HASH_HALTED))
+            return known;
+    }
+
+    long long offset = side == 0 ? 0 : (1LL << nodes[node].level) - 1;
+    hash_run r = descend(node, s, offset, true, max_steps);
+
+    // a run cut short by max_steps depends on it, and isn't remembered
+    if (r.exit != HASH_STOPPED)
+    {
+        if (cache.size() >= HASHCACHE)
+            cache.clear();
+        cache[key] = r;
+    }
+    return r;
+}
+
+// Run the machine inside a node as runFrom() does, by running it in one half after the
+// other for as long as the tape head passes between them
+hash_run hashlife_engine::descend(int node, state s, long long offset, bool entered, long long max_steps)
+{
+    int level = nodes[node].level;
+    long long half = 1LL << (level - 1);
+    int halves[2] = {nodes[node].left, nodes[node].right};
+
+    hash_run r;
+    r.exit = HASH_STOPPED;
+    r.halt_from = s;
+    r.last_move = 0;
+    r.ticks = 0;
+    r.min_offset = 2 * half;
+    r.max_offset = -1;
+
+    // Brent's algorithm notices if the tape head is trapped in the node forever (the
+    // halves, state and offset repeat): whole periods are then skipped
+    int saved_left = -1;
+    int saved_right = -1;
+    state saved_state = s;
+    long long saved_offset = -1;
+    long long saved_ticks = 0;
+    long long power = 1;
+    long long crossings = 0;
+
+    while (true)
+    {
+        int i = offset < half ? 0 : 1;
+        long long base = i * half;
+        hash_run part = runFrom(halves[i], s, offset - base, entered, max_steps - r.ticks);
+
+        halves[i] = part.node;
+        r.ticks += part.ticks;
+        if (part.min_offset <= part.max_offset)
+        {
+            r.min_offset = std::min(r.min_offset, base + part.min_offset);
+            r.max_offset = std::max(r.max_offset, base + part.max_offset);
+        }
+        if (part.last_move != 0)
+            r.last_move = part.last_move;
+        s = part.new_state;
+        offset = base + part.offset;
+        entered = true;
+
+        if (part.exit == HASH_HALTED || part.exit == HASH_STOPPED)
+        {
+            r.exit = part.exit;
+            r.halt_from = part.halt_from;
+            break;
+        }
+        if (offset < 0 || offset >= 2 * half)
+        {
+            r.exit = offset < 0 ? HASH_LEFT : HASH_RIGHT;
+            break;
+        }
+
+        crossings++;
+        if (halves[0] == saved_left && halves[1] == saved_right && s == saved_state && offset == saved_offset)
+        {
+            long long period = r.ticks - saved_ticks;
+            r.ticks += (max_steps - r.ticks) / period * period;
+        }
+        else if (crossings == power)
+        {
+            saved_left = halves[0];
+            saved_right = halves[1];
+            saved_state = s;
+            saved_offset = offset;
+            saved_ticks = r.ticks;
+            power *= 2;
+            crossings = 0;
+        }
+    }
+
+    r.node = join(halves[0], halves[1]);
+    r.new_state = s;
+    r.offset = offset;
+    return r;
+}
+
+// Run the machine until it halts or max_steps more ticks have passed. The tape is
+// made into a tree just big enough for it, which doubles (on the side the tape head
+// leaves it) whenever the tape head leaves it. The machine's tape, tape head and tick
+// count end up exactly as if it had been run with tm_engine::run().
+run_result hashlife_engine::run(long long max_steps)
+{
+    if (machine.isHalted() || max_steps <= 0)
+        return machine.getResult();
+
+    tape_head &th = machine.getTapeHead();
+    long long position = th.getTapeHeadLoc();
+    long long first, last;
+    if (!machine.getTape().findExtent(first, last))
+        first = last = position;
+    long long lo = std::min(first, position);
+    long long hi = std::max(last, position);
+
+    int level = 0;
+    while ((1LL << level) < hi - lo + 1)
+        level++;
+    long long origin = lo;
+    int root = build(level, origin, first, last);
+
+    state s = th.getCurrentState();
+    long long offset = position - origin;
+    bool entered = false;
+    long long ticks = machine.getTicks();
+    long long remaining = max_steps;
+    int last_move = 0;
+    hash_run r;
+
+    while (true)
+    {
+        r = runFrom(root, s, offset, entered, remaining);
+
+        root = r.node;
+        ticks += r.ticks;
+        remaining -= r.ticks;
+        s = r.new_state;
+        offset = r.offset;
+        if (r.min_offset <= r.max_offset)
+            machine.extendSpan(origin + r.min_offset, origin + r.max_offset);
+        if (r.last_move != 0)
+            last_move = r.last_move;
+
+        // (a tape head that reaches the deepest level is stopped there)
+        if (r.exit == HASH_HALTED || r.exit == HASH_STOPPED || level == HASHMAXLEVEL)
+            break;
+
+        // The tape head has left the tree: double it, with blank cells on that side
+        if (r.exit == HASH_LEFT)
+        {
+            root = join(empty(level), root);
+            origin -= 1LL << level;
+            offset += 1LL << level;
+        }
+        else
+        {
+            root = join(root, empty(level));
+        }
+        level++;
+        entered = true;
+
+        if (nodes.size() > node_limit)
+            root = compact(root);
+    }
+
+    store(root, origin, first, last);
+
+    th.setTapeHeadLoc(origin + offset);
+    th.setCurrentState(s);
+    // (as with run(), a machine that halts keeps the direction it had)
+    if (last_move != 0 && r.exit != HASH_HALTED)
+        th.setCurrentDirection(last_move < 0 ? LEFT : RIGHT);
+    machine.setTicks(ticks);
+    machine.setHalted(r.exit == HASH_HALTED);
+    if (r.exit == HASH_HALTED)
+    {
+        // (a halting rule doesn't write, so the symbol it read is still on the tape)
+        machine.setHaltRule(r.halt_from, machine.getTape().getTapeCell(origin + offset));
+    }
+
+    return machine.getResult();
+}
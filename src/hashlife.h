@@ -0,0 +1,98 @@
+#ifndef HASHLIFE_H
+#define HASHLIFE_H
+
+// Hash-consed tape with remembered runs, after Hashlife. The tape is a complete binary
+// tree: a node of level k stands for 2^k cells and is made of two nodes of level k - 1,
+// and a leaf (level 0) is one symbol. Every node is interned, so equal stretches of
+// tape are one and the same node wherever they occur. What the machine does inside a
+// node, entered at either end in a given state, until the tape head leaves it (or the
+// machine halts), is worked out once from its two halves and remembered, at every
+// level. A machine that builds a regular tape then meets the same few nodes over and
+// over, and takes a lookup per node visit instead of a tick per step: doubling the
+// ticks adds about a level. Ticks, tape, tape head, span and the halting rule end up
+// exactly as run() leaves them; rule hit counts aren't kept.
+
+#include "engine.h"
+#include <unordered_map>
+#include <vector>
+
+// Deepest level of the tree (the tape head has to stay within 2^HASHMAXLEVEL cells)
+#define HASHMAXLEVEL 60
+// Upper limit on remembered runs before the cache is emptied
+#define HASHCACHE (1 << 22)
+// Nodes there can be before the ones no longer part of the tape are thrown away
+#define HASHNODES (1 << 22)
+
+// How a run inside a node ended
+enum hash_exit
+{
+    HASH_LEFT,     // the tape head left the node to the left
+    HASH_RIGHT,    // ... or to the right
+    HASH_HALTED,   // a halting state was reached
+    HASH_STOPPED   // the ticks allowed ran out
+};
+
+// Two halves of a node (a leaf has neither: its id is its symbol)
+struct hash_node
+{
+    int left;
+    int right;
+    int level;
+};
+
+// Result of running the machine inside one node
+struct hash_run
+{
+    // the node afterwards
+    int node;
+    hash_exit exit;
+    // state afterwards (the halting state, if it halted), and the state that read
+    // the halting rule
+    state new_state;
+    state halt_from;
+    // -1 or 1 for the direction of the last move, 0 if the tape head didn't move
+    int last_move;
+    long long ticks;
+    // offset of the tape head afterwards: -1 if it left the node to the left, 2^k if
+    // it left to the right
+    long long offset;
+    // lowest and highest offsets in the node the tape head moved to (min_offset is
+    // above max_offset if there were none)
+    long long min_offset;
+    long long max_offset;
+};
+
+class hashlife_engine
+{
+    public:
+        hashlife_engine(tm_engine &);
+        run_result run(long long);
+        long long getNodeCount();
+        long long getCacheSize();
+    private:
+        int join(int,int);
+        int empty(int);
+        int build(int,long long,long long,long long);
+        void store(int,long long,long long,long long);
+        int compact(int);
+        int copyNode(int,std::vector<hash_node> &,std::unordered_map<int,int> &);
+        hash_run runFrom(int,state,long long,bool,long long);
+        hash_run enter(int,state,int,long long);
+        hash_run descend(int,state,long long,bool,long long);
+        hash_run step(int,state,bool,long long);
+        // The machine being run (its tape, tape head and tick count are read before
+        // the run and written back after it)
+        tm_engine &machine;
+        // every node, by id (ids below NUMSYM are the leaves), and the id of each
+        // pair of halves
+        std::vector<hash_node> nodes;
+        std::unordered_map<unsigned long long,int> interned;
+        // the all-blank node of each level
+        std::vector<int> empties;
+        // remembered runs, keyed by (node, state, end entered at)
+        std::unordered_map<unsigned long long,hash_run> cache;
+        // number of nodes at which the unused ones are next thrown away
+        size_t node_limit;
+};
+
+#endif
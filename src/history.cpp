@@ -0,0 +1,218 @@
+#include "history.h"
+#include <algorithm>
+
+history::history()
+{
+    first_step = 0;
+    snapshot_bytes = 0;
+    budget = HISTORYBUDGET;
+    pending_state = STATE_QA;
+    pending_symbol = BLANK;
+    pending_position = pending_min = pending_max = 0;
+}
+
+// Set the memory budget (bytes) for undo entries and snapshots together
+void history::setBudget(long long bytes)
+{
+    budget = bytes;
+    trim();
+}
+
+// Forget everything and start recording from the machine's current configuration
+void history::restart(tm_engine &machine)
+{
+    entries.clear();
+    snapshots.clear();
+    first_step = machine.getTicks();
+
+    snapshots.push_back(snapshot());
+    snapshots.back().step = first_step;
+    snapshots.back().machine = machine;
+    snapshot_bytes = snapshotBytes(snapshots.back());
+}
+
+// Tick of the oldest configuration that can still be gone back to
+long long history::getFirstTick()
+{
+    return first_step;
+}
+
+// Memory taken up by the undo entries and snapshots
+long long history::getMemoryUsed()
+{
+    return (long long)entries.size() * (long long)sizeof(unsigned short) + snapshot_bytes;
+}
+
+// Memory taken up by one snapshot
+long long history::snapshotBytes(snapshot &s)
+{
+    return (long long)sizeof(snapshot) + s.machine.getTape().getAllocatedBytes();
+}
+
+// Note the machine's configuration before a step (for display code that takes a
+// step in parts, through tm_engine::applyTransition() and tm_engine::advance())
+void history::beginStep(tm_engine &machine)
+{
+    run_result before = machine.getResult();
+    pending_state = before.final_state;
+    pending_position = machine.getTapeHead().getTapeHeadLoc();
+    pending_symbol = machine.getTape().getTapeCell(pending_position);
+    pending_min = before.tape_min;
+    pending_max = before.tape_max;
+}
+
+// Record the step taken since beginStep()
+void history::endStep(tm_engine &machine)
+{
+    run_result after = machine.getResult();
+    unsigned short entry = (unsigned short)((int)pending_state | ((int)pending_symbol << HISTORY_SYMBOL_SHIFT));
+
+    if (after.halted)
+        entry |= HISTORY_HALTED;
+    if (machine.getTapeHead().getTapeHeadLoc() > pending_position)
+        entry |= HISTORY_RIGHT;
+    if (after.tape_min < pending_min || after.tape_max > pending_max)
+        entry |= HISTORY_GREW;
+
+    entries.push_back(entry);
+
+    long long current = first_step + (long long)entries.size();
+    if (!after.halted && current - snapshots.back().step >= HISTORYSNAPSHOT)
+    {
+        snapshots.push_back(snapshot());
+        snapshots.back().step = current;
+        snapshots.back().machine = machine;
+        snapshot_bytes += snapshotBytes(snapshots.back());
+    }
+
+    trim();
+}
+
+// Step the machine one tick (see tm_engine::step()), recording the step.
+// Returns false once the machine has halted.
+bool history::step(tm_engine &machine)
+{
+    if (machine.isHalted())
+        return false;
+
+    beginStep(machine);
+    bool moved = machine.step();
+    endStep(machine);
+    return moved;
+}
+
+// Undo the last step. Returns false if there is no history left to undo.
+bool history::stepBack(tm_engine &machine)
+{
+    if (entries.empty())
+        return false;
+
+    unsigned short entry = entries.back();
+    entries.pop_back();
+
+    // a snapshot of the configuration being undone is no use any more
+    if (snapshots.back().step > first_step + (long long)entries.size())
+    {
+        snapshot_bytes -= snapshotBytes(snapshots.back());
+        snapshots.pop_back();
+    }
+
+    tape_head &th = machine.getTapeHead();
+
+    if (entry & HISTORY_HALTED)
+    {
+        // a halting transition only changed the state
+        machine.setHalted(false);
+    }
+    else
+    {
+        long long position = th.getTapeHeadLoc() + ((entry & HISTORY_RIGHT) ? -1 : 1);
+        th.setTapeHeadLoc(position);
+        machine.getTape().setTapeCell((symbol)((entry & HISTORY_SYMBOL) >> HISTORY_SYMBOL_SHIFT), position);
+
+        // the span grows by at most one cell a step, at the end the tape head moved towards
+        if (entry & HISTORY_GREW)
+        {
+            run_result r = machine.getResult();
+            if (entry & HISTORY_RIGHT)
+                machine.setSpan(r.tape_min, r.tape_max - 1);
+            else
+                machine.setSpan(r.tape_min + 1, r.tape_max);
+        }
+
+        machine.setTicks(machine.getTicks() - 1);
+        machine.addStateTicks(entry & HISTORY_STATE, -1);
+    }
+
+    th.setCurrentState((state)(entry & HISTORY_STATE));
+    machine.addHits(entry & HISTORY_STATE, (entry & HISTORY_SYMBOL) >> HISTORY_SYMBOL_SHIFT, -1);
+    // the direction shown is the one the previous step moved in
+    if (!entries.empty())
+        th.setCurrentDirection((entries.back() & HISTORY_RIGHT) ? RIGHT : LEFT);
+
+    return true;
+}
+
+// Put the machine in its configuration at a tick, going back through the history or
+// running forward as needed. Seeking to the tick a machine halted at gives the halted
+// machine. Returns false if the tick is before the oldest history kept (the machine
+// is then left at the oldest configuration), after the machine halts (it is left halted)
+// or more than HISTORYSEEKAHEAD ticks ahead (it is left that many ticks on).
+bool history::seek(tm_engine &machine, long long tick)
+{
+    long long current = first_step + (long long)entries.size();
+    bool reachable = tick >= first_step;
+    if (!reachable)
+        tick = first_step;
+
+    if (tick >= machine.getTicks())
+    {
+        long long stop = std::min(tick, machine.getTicks() + HISTORYSEEKAHEAD);
+        while (machine.getTicks() < stop && step(machine));
+        return machine.getTicks() == tick;
+    }
+
+    // the latest snapshot at or before the tick
+    size_t lo = 0, hi = snapshots.size();
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (snapshots[mid].step <= tick)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    if (current - tick <= tick - snapshots[lo].step)
+    {
+        // closer to where the machine is now: undo the steps in between
+        while ((machine.getTicks() > tick || machine.isHalted()) && stepBack(machine));
+        return reachable;
+    }
+
+    // closer to the snapshot: go back to it, forget everything after it and replay
+    while (snapshots.size() > lo + 1)
+    {
+        snapshot_bytes -= snapshotBytes(snapshots.back());
+        snapshots.pop_back();
+    }
+    entries.resize((size_t)(snapshots[lo].step - first_step));
+    machine = snapshots[lo].machine;
+
+    while (machine.getTicks() < tick && step(machine));
+    return reachable;
+}
+
+// Drop the oldest snapshot, with the undo entries up to the next one, while the
+// history is over budget (the latest snapshot and the entries after it are always kept)
+void history::trim()
+{
+    while (getMemoryUsed() > budget && snapshots.size() > 1)
+    {
+        long long next = snapshots[1].step;
+        entries.erase(entries.begin(), entries.begin() + (size_t)(next - first_step));
+        first_step = next;
+        snapshot_bytes -= snapshotBytes(snapshots.front());
+        snapshots.pop_front();
+    }
+}
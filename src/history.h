@@ -0,0 +1,69 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// Step history of a machine, for stepping backwards and seeking to any tick.
+// Each step leaves a two byte undo entry (the state and symbol from before the
+// step, the direction moved and whether the step widened the tape span), and a
+// full copy of the machine is kept every HISTORYSNAPSHOT steps. Going back a few
+// steps undoes entries one by one; seeking further finds the nearest snapshot by
+// binary search and replays forward from it. The oldest history is dropped to
+// stay within a memory budget.
+// The history is only valid for the rule-set and tape it was recorded with, so it
+// has to be restarted whenever either is edited by hand.
+
+#include "engine.h"
+#include <deque>
+
+// Steps between full copies of the machine
+#define HISTORYSNAPSHOT 4096
+// Default memory budget (bytes)
+#define HISTORYBUDGET (64 << 20)
+// Most ticks a seek runs the machine forward (so a far off tick can't hang the caller)
+#define HISTORYSEEKAHEAD (1 << 22)
+
+// Layout of an undo entry
+#define HISTORY_STATE   0x001F  // state before the step
+#define HISTORY_SYMBOL  0x00E0  // symbol under the tape head before the step
+#define HISTORY_SYMBOL_SHIFT 5
+#define HISTORY_RIGHT   0x0100  // the tape head moved right
+#define HISTORY_GREW    0x0200  // the step moved the tape head past the ends of the span
+#define HISTORY_HALTED  0x0400  // the step was a halting transition (no move, no tick)
+
+class history
+{
+    public:
+        history();
+        void setBudget(long long);
+        void restart(tm_engine &);
+        void beginStep(tm_engine &);
+        void endStep(tm_engine &);
+        bool step(tm_engine &);
+        bool stepBack(tm_engine &);
+        bool seek(tm_engine &,long long);
+        long long getFirstTick();
+        long long getMemoryUsed();
+    private:
+        struct snapshot
+        {
+            // step the copy was taken at
+            long long step;
+            tm_engine machine;
+        };
+        void trim();
+        long long snapshotBytes(snapshot &);
+        // undo entries, oldest first; entry i undoes step first_step + i
+        std::deque<unsigned short> entries;
+        long long first_step;
+        // snapshots, oldest first (the oldest is always at first_step)
+        std::deque<snapshot> snapshots;
+        long long snapshot_bytes;
+        long long budget;
+        // the machine before the step being recorded
+        state pending_state;
+        symbol pending_symbol;
+        long long pending_position;
+        long long pending_min;
+        long long pending_max;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "library.h"
+#include <algorithm>
+#include <string.h>
+
+static const char library_magic[8] = {'T','M','L','I','B','R','Y','1'};
+
+machine_library::machine_library()
+{
+    count = 0;
+}
+
+// Map a library into memory. Returns false if it can't be read or isn't a library.
+bool machine_library::open(const std::string &name)
+{
+    close();
+
+    if (!file.open(name))
+        return false;
+
+    const library_header *h = (const library_header *)file.data();
+    if (file.size() < LIBRARYHEADER || memcmp(h->magic, library_magic, sizeof(library_magic)) != 0 ||
+        h->record_bytes != RULESETBYTES)
+    {
+        file.close();
+        return false;
+    }
+
+    // (a library cut short keeps the machines that are there in full)
+    count = std::min(h->count, (file.size() - LIBRARYHEADER) / RULESETBYTES);
+    return true;
+}
+
+void machine_library::close()
+{
+    file.close();
+    count = 0;
+}
+
+long long machine_library::getCount()
+{
+    return count;
+}
+
+// The packed rules of machine i (one byte per rule, state after state), or NULL
+const unsigned char *machine_library::getRecord(long long i)
+{
+    if (i < 0 || i >= count)
+        return NULL;
+    return file.data() + LIBRARYHEADER + i * RULESETBYTES;
+}
+
+// Set a machine's rule-set to machine i of the library (the tape and tape head are
+// left alone). Returns false if there is no machine i, or it is damaged.
+bool machine_library::load(long long i, tm_engine &machine)
+{
+    const unsigned char *record = getRecord(i);
+    if (record == NULL)
+        return false;
+
+    transition rules[RULESETBYTES];
+    for (int k = 0; k < RULESETBYTES; ++k)
+    {
+        if (!decodeRule(record[k], rules[k]))
+            return false;
+        rules[k].curr_state = (state)(k / NUMSYM);
+        rules[k].curr_symbol = (symbol)(k % NUMSYM);
+    }
+
+    for (int k = 0; k < RULESETBYTES; ++k)
+        machine.setRule(k / NUMSYM, k % NUMSYM, rules[k]);
+    return true;
+}
+
+library_writer::library_writer()
+{
+    file = NULL;
+    count = 0;
+}
+
+library_writer::~library_writer()
+{
+    close();
+}
+
+// Open a library to add to, creating it if it doesn't exist yet.
+// Returns false if it can't be written, or is something other than a library.
+bool library_writer::open(const std::string &name)
+{
+    close();
+
+    library_header h;
+    file = fopen(name.c_str(), "r+b");
+    if (file != NULL)
+    {
+        if (fread(&h, sizeof(h), 1, file) != 1 || memcmp(h.magic, library_magic, sizeof(library_magic)) != 0 ||
+            h.record_bytes != RULESETBYTES)
+        {
+            fclose(file);
+            file = NULL;
+            return false;
+        }
+        count = h.count;
+        return true;
+    }
+
+    file = fopen(name.c_str(), "w+b");
+    if (file == NULL)
+        return false;
+
+    // (the whole header, so the new library is one straight away)
+    char header[LIBRARYHEADER];
+    memset(header, 0, sizeof(header));
+    count = 0;
+    if (fwrite(header, sizeof(header), 1, file) != 1 || !writeHeader())
+    {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Add a machine's rule-set to the end of the library. Returns its index (or -1 if it
+// couldn't be written).
+long long library_writer::add(tm_engine &machine)
+{
+    unsigned char record[RULESETBYTES];
+    for (int i = 0; i < NUMSTT; ++i)
+        for (int j = 0; j < NUMSYM; ++j)
+            record[i * NUMSYM + j] = encodeRule(machine.getRule(i, j));
+
+    if (file == NULL || fseek(file, LIBRARYHEADER + count * RULESETBYTES, SEEK_SET) != 0 ||
+        fwrite(record, sizeof(record), 1, file) != 1)
+        return -1;
+
+    count++;
+    if (count % LIBRARYSYNC == 0 && !writeHeader())
+        return -1;
+    return count - 1;
+}
+
+// Write the header with the count so far. Returns false if it can't be written.
+bool library_writer::writeHeader()
+{
+    library_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, library_magic, sizeof(library_magic));
+    h.count = count;
+    h.record_bytes = RULESETBYTES;
+    return fseek(file, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, file) == 1;
+}
+
+// Write the header (with the new count) and close the file. Returns false if the
+// header or the machines added couldn't all be written.
+bool library_writer::close()
+{
+    if (file == NULL)
+        return true;
+
+    bool written = writeHeader();
+    if (fclose(file) != 0)
+        written = false;
+    file = NULL;
+    return written;
+}
+
+// Add every rule-set in a text file to a library. A rule-set is the last word of a
+// line, so lines written by --enumerate and --batch can be read as they are; lines
+// without one are skipped. Returns the number of machines added.
+long long importLibrary(FILE *text, library_writer &library)
+{
+    tm_engine machine;
+    std::string line;
+    long long added = 0;
+    int c;
+
+    do
+    {
+        c = fgetc(text);
+        if (c != '\n' && c != EOF)
+        {
+            line += (char)c;
+            continue;
+        }
+
+        size_t end = line.find_last_not_of(" \t\r");
+        if (end != std::string::npos)
+        {
+            size_t start = line.find_last_of(" \t", end);
+            start = start == std::string::npos ? 0 : start + 1;
+            if (machine.parseRuleset(line.substr(start, end + 1 - start)) && library.add(machine) >= 0)
+                added++;
+        }
+        line.clear();
+    } while (c != EOF);
+
+    return added;
+}
+
+// Write every rule-set of a library as text, one per line, in the form parseRuleset()
+// reads (only as many states and symbols as the machine uses)
+void exportLibrary(machine_library &library, FILE *text)
+{
+    tm_engine machine;
+    int states, symbols;
+
+    for (long long i = 0; i < library.getCount(); ++i)
+    {
+        if (!library.load(i, machine))
+            continue;
+        usedSize(machine, states, symbols);
+        std::string rules = machine.rulesetString(states, symbols);
+        fprintf(text, "%s\n", rules.c_str());
+    }
+}
+
+// The number of states and symbols needed to write a rule-set out in text form:
+// every rule outside them is the default a/./left
+void usedSize(tm_engine &machine, int &states, int &symbols)
+{
+    states = 1;
+    symbols = 1;
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            const transition &rule = machine.getRule(i, j);
+            if (rule.next_state != STATE_QA || rule.write_symbol != BLANK || rule.move_head != LEFT)
+            {
+                states = std::max(states, i + 1);
+                symbols = std::max(symbols, j + 1);
+            }
+        }
+    }
+}
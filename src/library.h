@@ -0,0 +1,84 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+// A library of rule-sets in one binary file. Every rule is packed into one byte
+// ((next state * NUMSYM + symbol to write) * 2 + direction, 228 values in all), so a
+// whole 16 state, 6 symbol rule-set is RULESETBYTES bytes and they are stored back to
+// back after a header. Machine i is at LIBRARYHEADER + i * RULESETBYTES: a reader maps
+// the file into memory and finds any machine by arithmetic, without reading or parsing
+// the ones before it. Values are stored in the byte order of the machine that wrote
+// the library.
+
+#include "engine.h"
+#include "mapfile.h"
+#include <stdio.h>
+#include <string>
+
+// Bytes of one rule-set, and bytes reserved for the header
+#define RULESETBYTES (NUMSTT * NUMSYM)
+#define LIBRARYHEADER 64
+// Rule-sets added between rewrites of the header's count (so a writer that is killed
+// leaves a library holding all but the last few)
+#define LIBRARYSYNC 65536
+
+struct library_header
+{
+    // "TMLIBRY1"
+    char magic[8];
+    // number of rule-sets in the library
+    long long count;
+    // bytes per rule-set (RULESETBYTES when written)
+    long long record_bytes;
+};
+
+// One rule as a byte, and back (false for a byte that isn't a rule)
+inline unsigned char encodeRule(const transition &rule)
+{
+    return (unsigned char)(((int)rule.next_state * NUMSYM + (int)rule.write_symbol) * 2 + (int)rule.move_head);
+}
+
+inline bool decodeRule(unsigned char code, transition &rule)
+{
+    if (code >= (NUMSTT + 3) * NUMSYM * 2)
+        return false;
+    rule.next_state = (state)(code / (NUMSYM * 2));
+    rule.write_symbol = (symbol)(code / 2 % NUMSYM);
+    rule.move_head = (direction)(code & 1);
+    return true;
+}
+
+// Read access to a library, through a memory map
+class machine_library
+{
+    public:
+        machine_library();
+        bool open(const std::string &);
+        void close();
+        long long getCount();
+        const unsigned char *getRecord(long long);
+        bool load(long long,tm_engine &);
+    private:
+        mapped_file file;
+        long long count;
+};
+
+// Adds rule-sets to the end of a library (creating it if need be)
+class library_writer
+{
+    public:
+        library_writer();
+        ~library_writer();
+        bool open(const std::string &);
+        long long add(tm_engine &);
+        bool close();
+    private:
+        bool writeHeader();
+        FILE *file;
+        long long count;
+};
+
+long long importLibrary(FILE *,library_writer &);
+void exportLibrary(machine_library &,FILE *);
+void usedSize(tm_engine &,int &,int &);
+
+#endif
@@ -0,0 +1,317 @@
+#include "macro.h"
+
+// Upper limit on remembered block transitions before the cache is emptied
+#define MACROCACHE (1 << 22)
+
+macro_engine::macro_engine(tm_engine &m, int k) : machine(m)
+{
+    // clamp the block size to something that can be encoded
+    if (k < 1)
+        k = 1;
+    if (k > MAXBLOCK)
+        k = MAXBLOCK;
+    block_size = k;
+
+    place_value[0] = 1;
+    for (int i = 1; i < block_size; ++i)
+        place_value[i] = place_value[i - 1] * NUMSYM;
+}
+
+// Number of block transitions worked out so far
+long long macro_engine::getCacheSize()
+{
+    return (long long)cache.size();
+}
+
+// Block number of a tape cell (rounding down for negative positions)
+long long macro_engine::blockOf(long long position)
+{
+    if (position >= 0)
+        return position / block_size;
+    return -((-position - 1) / block_size) - 1;
+}
+
+// Split an encoded block into its cells
+void macro_engine::decodeBlock(unsigned int code, symbol *cells)
+{
+    for (int i = 0; i < block_size; ++i)
+    {
+        cells[i] = (symbol)(code % NUMSYM);
+        code /= NUMSYM;
+    }
+}
+
+// Encode the cells of a block as one number (cell i being digit i in base NUMSYM)
+unsigned int macro_engine::encodeBlock(const symbol *cells)
+{
+    unsigned int code = 0;
+    for (int i = block_size - 1; i >= 0; --i)
+        code = code * NUMSYM + (unsigned int)cells[i];
+    return code;
+}
+
+// Getter for a block of the macro tape (blocks never visited are blank, which encodes as 0)
+unsigned int macro_engine::getBlock(long long b)
+{
+    if (b >= 0)
+        return (size_t)b < right_blocks.size() ? right_blocks[(size_t)b] : 0;
+    size_t index = (size_t)(-b - 1);
+    return index < left_blocks.size() ? left_blocks[index] : 0;
+}
+
+// Setter for a block of the macro tape
+void macro_engine::setBlock(long long b, unsigned int code)
+{
+    std::vector<unsigned int> &blocks = b >= 0 ? right_blocks : left_blocks;
+    size_t index = (size_t)(b >= 0 ? b : -b - 1);
+
+    if (index >= blocks.size())
+        blocks.resize(index + 1, 0);
+    blocks[index] = code;
+}
+
+// Step the base machine inside one block, with the same semantics as tm_engine::step(),
+// until the tape head leaves the block, a halting state is reached or max_steps ticks
+// have passed. The block's encoding is kept up to date as cells are written.
+// Returns the number of ticks taken.
+long long macro_engine::runInBlock(symbol *cells, unsigned int &code, state &s, int &offset,
+                                   long long max_steps, int &min_offset, int &max_offset)
+{
+    long long steps = 0;
+
+    while (steps < max_steps && offset >= 0 && offset < block_size && !isHaltingState(s))
+    {
+        symbol current_symbol = cells[offset];
+        const transition &rule = machine.getRule((int)s, (int)current_symbol);
+
+        s = rule.next_state;
+
+        // a halting transition doesn't write, move or count as a tick
+        if (isHaltingState(s))
+            break;
+
+        cells[offset] = rule.write_symbol;
+        code = code - (unsigned int)current_symbol * place_value[offset]
+                    + (unsigned int)rule.write_symbol * place_value[offset];
+        offset += rule.move_head == LEFT ? -1 : 1;
+        steps++;
+
+        if (offset >= 0 && offset < block_size)
+        {
+            if (offset < min_offset)
+                min_offset = offset;
+            if (offset > max_offset)
+                max_offset = offset;
+        }
+    }
+
+    return steps;
+}
+
+// Find (working out and remembering on first use) what the base machine does inside
+// a block entered in state s with the tape head at the given offset.
+const macro_transition &macro_engine::lookup(unsigned int block, state s, int offset)
+{
+    unsigned long long key = ((unsigned long long)block * NUMSTT + (unsigned long long)s) * block_size + offset;
+
+    std::unordered_map<unsigned long long,macro_transition>::iterator it = cache.find(key);
+    if (it != cache.end())
+        return it->second;
+
+    if (cache.size() >= MACROCACHE)
+        cache.clear();
+
+    macro_transition result;
+    symbol cells[MAXBLOCK];
+    decodeBlock(block, cells);
+
+    unsigned int code = block;
+    state curr_state = s;
+    int curr_offset = offset;
+    result.min_offset = result.max_offset = offset;
+    result.loops = false;
+    result.loop_start = 0;
+    result.loop_period = 0;
+    result.steps = 0;
+
+    // Step one tick at a time, using Brent's algorithm to notice if the tape head is
+    // trapped in the block forever (the block, state and offset repeat).
+    unsigned int saved_code = code;
+    state saved_state = curr_state;
+    int saved_offset = curr_offset;
+    long long power = 1;
+    long long period = 0;
+
+    while (true)
+    {
+        result.halt_from = curr_state;
+        if (runInBlock(cells, code, curr_state, curr_offset, 1, result.min_offset, result.max_offset) == 0)
+            break;
+        result.steps++;
+
+        if (curr_offset < 0 || curr_offset >= block_size)
+            break;
+
+        period++;
+        if (code == saved_code && curr_state == saved_state && curr_offset == saved_offset)
+        {
+            result.loops = true;
+            result.loop_period = period;
+            break;
+        }
+        if (period == power)
+        {
+            saved_code = code;
+            saved_state = curr_state;
+            saved_offset = curr_offset;
+            power *= 2;
+            period = 0;
+        }
+    }
+
+    if (result.loops)
+    {
+        // Find where the loop starts by running two copies loop_period ticks apart
+        // until they meet.
+        symbol lead_cells[MAXBLOCK], trail_cells[MAXBLOCK];
+        decodeBlock(block, lead_cells);
+        decodeBlock(block, trail_cells);
+        unsigned int lead_code = block, trail_code = block;
+        state lead_state = s, trail_state = s;
+        int lead_offset = offset, trail_offset = offset;
+        int lo = offset, hi = offset;
+
+        runInBlock(lead_cells, lead_code, lead_state, lead_offset, result.loop_period, lo, hi);
+        while (lead_code != trail_code || lead_state != trail_state || lead_offset != trail_offset)
+        {
+            runInBlock(lead_cells, lead_code, lead_state, lead_offset, 1, lo, hi);
+            runInBlock(trail_cells, trail_code, trail_state, trail_offset, 1, lo, hi);
+            result.loop_start++;
+        }
+    }
+
+    result.new_block = code;
+    result.new_state = curr_state;
+    result.exit_offset = curr_offset;
+
+    return cache[key] = result;
+}
+
+// Copy the machine's tape into blocks
+void macro_engine::loadTape()
+{
+    long long first, last;
+    machine.getTape().getAllocatedRange(first, last);
+
+    symbol cells[MAXBLOCK];
+    right_blocks.clear();
+    left_blocks.clear();
+
+    for (long long b = blockOf(first); b <= blockOf(last); ++b)
+    {
+        for (int i = 0; i < block_size; ++i)
+            cells[i] = machine.getTape().getTapeCell(b * block_size + i);
+        setBlock(b, encodeBlock(cells));
+    }
+}
+
+// Copy the blocks back onto the machine's tape
+void macro_engine::storeTape()
+{
+    symbol cells[MAXBLOCK];
+    tape &t = machine.getTape();
+
+    for (long long b = -(long long)left_blocks.size(); b < (long long)right_blocks.size(); ++b)
+    {
+        decodeBlock(getBlock(b), cells);
+        for (int i = 0; i < block_size; ++i)
+        {
+            // don't allocate tape pages just to write blanks on them
+            if (t.getTapeCell(b * block_size + i) != cells[i])
+                t.setTapeCell(cells[i], b * block_size + i);
+        }
+    }
+}
+
+// Run the machine until it halts or max_steps more ticks have passed, one block
+// visit at a time. The machine's tape, tape head and tick count end up exactly as
+// if it had been run with tm_engine::run().
+run_result macro_engine::run(long long max_steps)
+{
+    if (machine.isHalted())
+        return machine.getResult();
+
+    loadTape();
+
+    tape_head &th = machine.getTapeHead();
+    long long position = th.getTapeHeadLoc();
+    state s = th.getCurrentState();
+    long long ticks = machine.getTicks();
+    long long remaining = max_steps;
+
+    while (remaining > 0 && !isHaltingState(s))
+    {
+        long long b = blockOf(position);
+        long long block_start = b * block_size;
+        int offset = (int)(position - block_start);
+        unsigned int code = getBlock(b);
+
+        const macro_transition &t = lookup(code, s, offset);
+
+        if (t.loops || t.steps > remaining || (t.steps == remaining && isHaltingState(t.new_state)))
+        {
+            // The block transition doesn't fit in the ticks that are left (a halting
+            // transition counts as one more): step the base machine for exactly the
+            // remaining ticks instead. A loop is skipped
+            // over a whole number of periods at a time.
+            long long n = remaining;
+            if (t.loops && remaining > t.loop_start)
+                n = t.loop_start + (remaining - t.loop_start) % t.loop_period;
+
+            int lo = offset, hi = offset;
+            symbol cells[MAXBLOCK];
+            decodeBlock(code, cells);
+            runInBlock(cells, code, s, offset, n, lo, hi);
+            if (t.loops && remaining >= t.loop_start + t.loop_period)
+            {
+                lo = t.min_offset;
+                hi = t.max_offset;
+            }
+
+            setBlock(b, code);
+            machine.extendSpan(block_start + lo, block_start + hi);
+            position = block_start + offset;
+            ticks += remaining;
+            remaining = 0;
+            break;
+        }
+
+        setBlock(b, t.new_block);
+        machine.extendSpan(block_start + t.min_offset, block_start + t.max_offset);
+        s = t.new_state;
+        position = block_start + t.exit_offset;
+        ticks += t.steps;
+        remaining -= t.steps;
+
+        // The tape head has moved onto the next block
+        if (isHaltingState(s))
+        {
+            // (a halting rule doesn't write, so the symbol it read is still in the block)
+            machine.setHaltRule(t.halt_from, (symbol)(t.new_block / place_value[t.exit_offset] % NUMSYM));
+        }
+        else
+        {
+            machine.extendSpan(position, position);
+            th.setCurrentDirection(t.exit_offset < 0 ? LEFT : RIGHT);
+        }
+    }
+
+    storeTape();
+
+    th.setTapeHeadLoc(position);
+    th.setCurrentState(s);
+    machine.setTicks(ticks);
+    machine.setHalted(isHaltingState(s));
+
+    return machine.getResult();
+}
@@ -0,0 +1,70 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+// Macro-machine acceleration: the tape is viewed as blocks of k adjacent
+// cells, and what the base machine does inside a block (from a given state and
+// tape head offset, until the tape head leaves the block) is worked out once and
+// remembered. Long runs then advance one block visit per lookup instead of one
+// tick per step, while the tick count stays exact.
+
+#include "engine.h"
+#include <unordered_map>
+
+// Largest block size (NUMSYM^MAXBLOCK has to fit in an unsigned int)
+#define MAXBLOCK 12
+
+// Result of running the base machine inside one block
+struct macro_transition
+{
+    // contents of the block afterwards
+    unsigned int new_block;
+    // state of the tape head afterwards
+    state new_state;
+    // offset of the tape head afterwards: -1 if it left the block to the left,
+    // k if it left to the right, otherwise the offset it halted at
+    int exit_offset;
+    // number of base machine ticks
+    long long steps;
+    // state the tape head was in when it read the halting rule (if it halted)
+    state halt_from;
+    // lowest and highest offsets the tape head was above
+    int min_offset;
+    int max_offset;
+    // true if the tape head never leaves the block and never halts; it then
+    // repeats the same loop_period ticks forever after the first loop_start ticks
+    bool loops;
+    long long loop_start;
+    long long loop_period;
+};
+
+class macro_engine
+{
+    public:
+        macro_engine(tm_engine &,int);
+        run_result run(long long);
+        long long getCacheSize();
+    private:
+        const macro_transition &lookup(unsigned int,state,int);
+        long long runInBlock(symbol *,unsigned int &,state &,int &,long long,int &,int &);
+        void decodeBlock(unsigned int,symbol *);
+        unsigned int encodeBlock(const symbol *);
+        unsigned int getBlock(long long);
+        void setBlock(long long,unsigned int);
+        long long blockOf(long long);
+        void loadTape();
+        void storeTape();
+        // The machine being accelerated (its tape, tape head and tick count
+        // are read before the run and written back after it)
+        tm_engine &machine;
+        // number of cells per block (k)
+        int block_size;
+        // NUMSYM^i, the weight of the cell at offset i in a block's encoding
+        unsigned int place_value[MAXBLOCK];
+        // remembered block transitions, keyed by (block, state, entry offset)
+        std::unordered_map<unsigned long long,macro_transition> cache;
+        // blocks 0, 1, 2... and blocks -1, -2, -3... of the tape
+        std::vector<unsigned int> right_blocks;
+        std::vector<unsigned int> left_blocks;
+};
+
+#endif
@@ -1,4 +1,17 @@
 #include "turing.h"
+#include "macro.h"
+#include "rle.h"
+#include "hashlife.h"
+#include "trace.h"
+#include "bench.h"
+#include "batch.h"
+#include "search.h"
+#include "decider.h"
+#include "canon.h"
+#include "sized.h"
+#include "shard.h"
+#include "accept.h"
+#include "diagram.h"
 
 void initColor()
 {
@@ -30,9 +43,768 @@ void initCurses()
     PDC_set_title("Turing Machine Explorer");
 }
 
+// Print command line usage for the headless mode
+void printUsage()
+{
+    std::cout << "usage: turing [options]\n"
+              << "  (no options)     run the interactive explorer\n"
+              << "  --rules TEXT     rule-set in text form, i.e. bXrHXl_aXlbXr\n"
+              << "  --random SEED    use a random rule-set (as the 'r' key does)\n"
+              << "  --size S Y       make the rule-sets of --random and --batch S states and Y\n"
+              << "                   symbols (default " << NUMSTT << " and " << NUMSYM << ")\n"
+              << "  --steps N        stop after N ticks (default 1000000)\n"
+              << "  --macro K        run as a macro machine with blocks of K cells\n"
+              << "  --rle            run on a run-length encoded tape, jumping over runs the\n"
+              << "                   machine sweeps across in one state\n"
+              << "  --hashlife       run on a hash-consed tape, remembering what the machine does\n"
+              << "                   in every stretch of tape it meets (for regular tapes and\n"
+              << "                   very long runs)\n"
+              << "  --sized          run with the step loop compiled for the machine's size (2 to\n"
+              << "                   6 states with 2 to 4 symbols): faster for cyclers, slower\n"
+              << "                   for machines that run off along the tape\n"
+              << "  --tape FORMAT    store the tape as bytes (default), packed (3 bits a cell)\n"
+              << "                   or bits (1 bit a cell, for two symbol machines)\n"
+              << "  --trace BASE     record every step to the trace files BASE.0, BASE.1 ...\n"
+              << "                   (not with --decide, --macro, --rle, --hashlife or the\n"
+              << "                   options that run many machines, such as --enumerate)\n"
+              << "  --replay BASE    show a recorded trace in the explorer\n"
+              << "  --diagram FILE   draw the run as a space-time diagram (a row per moment, a\n"
+              << "                   column per cell) to FILE, a PNG if it ends in .png or a PPM;\n"
+              << "                   long runs and wide tapes are scaled down to fit (not with\n"
+              << "                   --decide, --macro, --rle, --hashlife or the options that\n"
+              << "                   run many machines, such as --enumerate)\n"
+              << "  --diagram-size W H\n"
+              << "                   size of the diagram in pixels (default " << DIAGRAMWIDTH << " by "
+              << DIAGRAMHEIGHT << ")\n"
+              << "  --hits FILE      write how often each rule was used to FILE (as CSV; not\n"
+              << "                   kept by --macro or --hashlife)\n"
+              << "  --decide         run under the deciders, stopping once the machine is proven\n"
+              << "                   never to halt\n"
+              << "  --enumerate S Y  enumerate every S state, Y symbol machine (tree normal form),\n"
+              << "                   running each for at most --steps ticks\n"
+              << "  --threads T      worker threads for --enumerate and --accept (default: one per\n"
+              << "                   core)\n"
+              << "  --dedup          with --enumerate or --batch, skip machines that are the same\n"
+              << "                   as one already run but for renamed states or symbols,\n"
+              << "                   mirroring or rules that can never be used\n"
+              << "  --batch N        run N random rule-sets (seeded by --random), or N machines\n"
+              << "                   of the --library from --index on, for at most --steps ticks\n"
+              << "                   each, several machines at a time\n"
+              << "  --library FILE   machine library: run machine --index of it, or (on its own)\n"
+              << "                   open the explorer with it\n"
+              << "  --index I        machine of the library to run (default 0)\n"
+              << "  --import TEXT    add the rule-sets in TEXT (the last word of each line) to\n"
+              << "                   the --library, creating it if need be\n"
+              << "  --export TEXT    write the rule-sets of the --library to TEXT, one per line\n"
+              << "  --accept INPUTS  run the machine on every line of INPUTS (written on the tape\n"
+              << "                   from the tape head on), on all cores, writing accept, reject,\n"
+              << "                   halt or timeout and the ticks for each, in order\n"
+              << "  --bench          run the benchmark corpus under every engine and tape format,\n"
+              << "                   writing a line of JSON per run\n"
+              << "  --output FILE    where --enumerate, --batch, --accept and --bench write their\n"
+              << "                   results (default: stdout)\n"
+              << "  --shard K/N      run shard K (0 to N-1) of N of an --enumerate, or of a random\n"
+              << "                   --batch, checkpointing to the --output file + " CHECKPOINTSUFFIX "; run\n"
+              << "                   again, it carries on from its last checkpoint\n"
+              << "  --merge FILE...  write the results of every finished shard's --output FILE\n"
+              << "                   to --output, and their totals (the last option)\n";
+}
+
+// Report the totals of a search (on stderr, since the results themselves may be
+// going to stdout)
+void printTotals(const search_totals &totals, bool dedup)
+{
+    std::cerr << "machines:  " << totals.machines << "\n"
+              << "halted:    " << totals.halted << "\n"
+              << "looping:   " << totals.looping << "\n"
+              << "undecided: " << totals.undecided << "\n"
+              << "champion:  " << totals.champion_ticks << " ticks " << totals.champion_rules << "\n";
+    if (dedup)
+        std::cerr << "duplicates: " << totals.duplicates << " (not run)\n";
+}
+
+// Enumerate all machines of one size and report the totals (on stderr, since the
+// results themselves may be going to stdout). Returns the program exit code.
+int runEnumeration(int states, int symbols, long long max_steps, int threads, bool dedup, const char *output_name)
+{
+    FILE *out = stdout;
+    if (output_name != NULL && (out = fopen(output_name, "w")) == NULL)
+    {
+        std::cerr << "can't write " << output_name << "\n";
+        return 1;
+    }
+
+    dedup_set seen;
+    tnf_search search(states, symbols, max_steps, threads);
+    if (dedup)
+        search.setDedup(&seen);
+    search_totals totals = search.run(out);
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    printTotals(totals, dedup);
+    return 0;
+}
+
+// Run (or carry on with) one shard of an enumeration or a seeded random search, and
+// report its totals once it has finished. Returns the program exit code.
+int runShardJob(const shard_job &job, int threads, const char *output_name)
+{
+    if (output_name == NULL)
+    {
+        std::cerr << "--shard needs an --output file\n";
+        return 1;
+    }
+
+    search_totals totals;
+    shard_status status = runShard(job, threads, output_name, totals);
+    if (status == SHARD_OTHER_JOB)
+    {
+        std::cerr << "the checkpoint " << output_name << CHECKPOINTSUFFIX << " is for another search\n";
+        return 1;
+    }
+    if (status != SHARD_OK)
+    {
+        std::cerr << "can't write " << output_name << " (or its checkpoint)\n";
+        return 1;
+    }
+
+    printTotals(totals, job.dedup);
+    return 0;
+}
+
+// Put the results of finished shards together. Returns the program exit code.
+int runMerge(const std::vector<std::string> &names, const char *output_name)
+{
+    FILE *out = stdout;
+    if (output_name != NULL && (out = fopen(output_name, "w")) == NULL)
+    {
+        std::cerr << "can't write " << output_name << "\n";
+        return 1;
+    }
+
+    search_totals totals;
+    std::string problem;
+    shard_status status = mergeShards(names, out, totals, problem);
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    if (status == SHARD_UNFINISHED && problem.empty())
+        std::cerr << "some shards of the search are missing\n";
+    else if (status == SHARD_UNFINISHED)
+        std::cerr << problem << " hasn't finished (or has no checkpoint)\n";
+    else if (status == SHARD_OTHER_JOB)
+        std::cerr << problem << " is from another search, or the same shard twice\n";
+    else if (status != SHARD_OK)
+        std::cerr << "can't read " << problem << "\n";
+    if (status != SHARD_OK)
+        return 1;
+
+    printTotals(totals, totals.duplicates > 0);
+    return 0;
+}
+
+// Run a batch of random machines made from the seed (or count machines of a library,
+// from machine first on) and report the totals (on stderr, like runEnumeration()).
+// Returns the program exit code.
+int runBatch(long long count, long long max_steps, unsigned long long seed, int states, int symbols, bool dedup,
+             const char *output_name, machine_library *library, long long first)
+{
+    FILE *out = stdout;
+    if (output_name != NULL && (out = fopen(output_name, "w")) == NULL)
+    {
+        std::cerr << "can't write " << output_name << "\n";
+        return 1;
+    }
+
+    clock_t start = clock();
+    search_totals totals;
+    {
+        dedup_set seen;
+        triage_batch machines(count, out);
+        machines.setSize(states, symbols);
+        // (made the way --shard makes them, so a sharded search is this one split up)
+        if (library != NULL)
+            machines.setLibrary(library, first);
+        else
+            machines.setSeed(seed, 0);
+        if (dedup)
+            machines.setDedup(&seen);
+        batch_engine batch(max_steps);
+        batch.run(machines);
+        totals = machines.getTotals();
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    printTotals(totals, dedup);
+    if (seconds > 0)
+        std::cerr << "machines/sec: " << (long long)(totals.machines / seconds) << "\n";
+    return 0;
+}
+
+// Run the machine on every input of a file and report the totals (on stderr, like
+// runEnumeration()). Returns the program exit code.
+int runAccept(tm_engine &machine, const char *input_name, long long max_steps, int threads, const char *output_name)
+{
+    FILE *in = fopen(input_name, "r");
+    if (in == NULL)
+    {
+        std::cerr << "can't read " << input_name << "\n";
+        return 1;
+    }
+    FILE *out = stdout;
+    if (output_name != NULL && (out = fopen(output_name, "w")) == NULL)
+    {
+        std::cerr << "can't write " << output_name << "\n";
+        fclose(in);
+        return 1;
+    }
+
+    accept_totals totals = runAcceptance(machine, in, out, max_steps, threads);
+
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    std::cerr << "inputs:    " << totals.inputs << "\n"
+              << "accepted:  " << totals.accepted << "\n"
+              << "rejected:  " << totals.rejected << "\n"
+              << "halted:    " << totals.halted << "\n"
+              << "timeouts:  " << totals.timeouts << "\n"
+              << "ticks:     " << totals.ticks << "\n";
+    if (totals.invalid > 0)
+        std::cerr << "invalid:   " << totals.invalid << " (not run)\n";
+    return 0;
+}
+
+// Add the rule-sets of a text file to a library. Returns the program exit code.
+int runImport(const char *text_name, const char *library_name)
+{
+    FILE *text = fopen(text_name, "r");
+    if (text == NULL)
+    {
+        std::cerr << "can't read " << text_name << "\n";
+        return 1;
+    }
+
+    library_writer library;
+    if (!library.open(library_name))
+    {
+        std::cerr << "can't write " << library_name << "\n";
+        fclose(text);
+        return 1;
+    }
+
+    long long added = importLibrary(text, library);
+    fclose(text);
+    if (!library.close())
+    {
+        std::cerr << "can't write " << library_name << "\n";
+        return 1;
+    }
+
+    std::cerr << "added " << added << " machines to " << library_name << "\n";
+    return 0;
+}
+
+// Write the rule-sets of a library to a text file. Returns the program exit code.
+int runExport(machine_library &library, const char *text_name)
+{
+    FILE *text = fopen(text_name, "w");
+    if (text == NULL)
+    {
+        std::cerr << "can't write " << text_name << "\n";
+        return 1;
+    }
+
+    exportLibrary(library, text);
+    fclose(text);
+    return 0;
+}
+
+// Run the machine with no display as fast as possible and report the result.
+// Returns the program exit code.
+int runHeadless(int argc, char* argv[])
+{
+    tm_engine machine;
+    long long max_steps = 1000000;
+    bool random_rules = false;
+    unsigned long long random_seed = 0;
+    int rule_states = NUMSTT;
+    int rule_symbols = NUMSYM;
+    int block_size = 0;
+    bool rle = false;
+    bool hashlife = false;
+    bool sized = false;
+    bool decide = false;
+    int enum_states = 0;
+    int enum_symbols = 0;
+    int threads = 0;
+    long long batch_count = 0;
+    bool dedup = false;
+    const char *library_name = NULL;
+    long long library_index = 0;
+    const char *import_name = NULL;
+    const char *export_name = NULL;
+    const char *accept_name = NULL;
+    const char *output_name = NULL;
+    const char *trace_name = NULL;
+    const char *hits_name = NULL;
+    const char *diagram_name = NULL;
+    int diagram_width = DIAGRAMWIDTH;
+    int diagram_height = DIAGRAMHEIGHT;
+    bool bench = false;
+    int shard = -1;
+    int shards = 0;
+    std::vector<std::string> merge_names;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--rules" && has_value)
+        {
+            if (!machine.parseRuleset(argv[++i]))
+            {
+                std::cerr << "malformed rule-set: " << argv[i] << "\n";
+                return 1;
+            }
+            random_rules = false;
+        }
+        else if (arg == "--random" && has_value)
+        {
+            random_seed = strtoull(argv[++i], NULL, 10);
+            srand((unsigned)random_seed);
+            random_rules = true;
+        }
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            rule_states = atoi(argv[++i]);
+            rule_symbols = atoi(argv[++i]);
+            if (rule_states < 1 || rule_states > NUMSTT || rule_symbols < 2 || rule_symbols > NUMSYM)
+            {
+                std::cerr << "--size needs 1-" << NUMSTT << " states and 2-" << NUMSYM << " symbols\n";
+                return 1;
+            }
+        }
+        else if (arg == "--macro" && has_value)
+        {
+            block_size = atoi(argv[++i]);
+        }
+        else if (arg == "--trace" && has_value)
+        {
+            trace_name = argv[++i];
+        }
+        else if (arg == "--hits" && has_value)
+        {
+            hits_name = argv[++i];
+        }
+        else if (arg == "--diagram" && has_value)
+        {
+            diagram_name = argv[++i];
+        }
+        else if (arg == "--diagram-size" && i + 2 < argc)
+        {
+            diagram_width = atoi(argv[++i]);
+            diagram_height = atoi(argv[++i]);
+            if (diagram_width < 2 || diagram_height < 2)
+            {
+                std::cerr << "--diagram-size needs a width and height of at least 2\n";
+                return 1;
+            }
+        }
+        else if (arg == "--bench")
+        {
+            bench = true;
+        }
+        else if (arg == "--rle")
+        {
+            rle = true;
+        }
+        else if (arg == "--hashlife")
+        {
+            hashlife = true;
+        }
+        else if (arg == "--sized")
+        {
+            sized = true;
+        }
+        else if (arg == "--tape" && has_value)
+        {
+            std::string name = argv[++i];
+            if (name == "bytes")
+                machine.getTape().setFormat(TAPE_BYTES);
+            else if (name == "packed")
+                machine.getTape().setFormat(TAPE_PACKED);
+            else if (name == "bits")
+                machine.getTape().setFormat(TAPE_BITS);
+            else
+            {
+                std::cerr << "unknown tape format: " << name << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--decide")
+        {
+            decide = true;
+        }
+        else if (arg == "--enumerate" && i + 2 < argc)
+        {
+            enum_states = atoi(argv[++i]);
+            enum_symbols = atoi(argv[++i]);
+            if (enum_states < 1 || enum_states > NUMSTT || enum_symbols < 2 || enum_symbols > NUMSYM)
+            {
+                std::cerr << "--enumerate needs 1-" << NUMSTT << " states and 2-" << NUMSYM << " symbols\n";
+                return 1;
+            }
+        }
+        else if (arg == "--library" && has_value)
+        {
+            library_name = argv[++i];
+        }
+        else if (arg == "--index" && has_value)
+        {
+            library_index = atoll(argv[++i]);
+        }
+        else if (arg == "--import" && has_value)
+        {
+            import_name = argv[++i];
+        }
+        else if (arg == "--export" && has_value)
+        {
+            export_name = argv[++i];
+        }
+        else if (arg == "--accept" && has_value)
+        {
+            accept_name = argv[++i];
+        }
+        else if (arg == "--batch" && has_value)
+        {
+            batch_count = atoll(argv[++i]);
+        }
+        else if (arg == "--dedup")
+        {
+            dedup = true;
+        }
+        else if (arg == "--threads" && has_value)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (arg == "--output" && has_value)
+        {
+            output_name = argv[++i];
+        }
+        else if (arg == "--steps" && has_value)
+        {
+            max_steps = atoll(argv[++i]);
+        }
+        else if (arg == "--shard" && has_value)
+        {
+            if (sscanf(argv[++i], "%d/%d", &shard, &shards) != 2 || shards < 1 || shard < 0 || shard >= shards)
+            {
+                std::cerr << "--shard needs K/N, with K from 0 to N-1\n";
+                return 1;
+            }
+        }
+        else if (arg == "--merge" && has_value)
+        {
+            while (i + 1 < argc)
+                merge_names.push_back(argv[++i]);
+        }
+        else
+        {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // --sized is another engine for the same run as run()
+    if (sized && (decide || block_size > 0 || rle || hashlife))
+    {
+        std::cerr << "--sized can't be used with --decide, --macro, --rle or --hashlife\n";
+        return 1;
+    }
+    // a diagram is drawn between chunks of run(), which the other engines don't go through
+    if (diagram_name != NULL && (decide || block_size > 0 || rle || hashlife))
+    {
+        std::cerr << "--diagram can't be used with --decide, --macro, --rle or --hashlife\n";
+        return 1;
+    }
+    // and a trace is recorded by run() too
+    if (trace_name != NULL && (decide || block_size > 0 || rle || hashlife))
+    {
+        std::cerr << "--trace can't be used with --decide, --macro, --rle or --hashlife\n";
+        return 1;
+    }
+
+    // searches, batches, benchmarks, acceptance runs and the library commands run many
+    // machines (or none) and return before the single run that would be recorded or drawn
+    bool single_run = enum_states == 0 && batch_count == 0 && accept_name == NULL && !bench && shard < 0 &&
+                      merge_names.empty() && import_name == NULL && export_name == NULL;
+    if (trace_name != NULL && !single_run)
+    {
+        std::cerr << "--trace can't be used with --enumerate, --batch, --accept, --bench, --shard, --merge, "
+                  << "--import or --export\n";
+        return 1;
+    }
+    if (diagram_name != NULL && !single_run)
+    {
+        std::cerr << "--diagram can't be used with --enumerate, --batch, --accept, --bench, --shard, --merge, "
+                  << "--import or --export\n";
+        return 1;
+    }
+
+    // (made once every option is in, so that --size can come after --random)
+    if (random_rules)
+        machine.setupTransitionTable(true, rule_states, rule_symbols);
+
+    if (!merge_names.empty())
+        return runMerge(merge_names, output_name);
+
+    if (shard >= 0 && (enum_states > 0 || (batch_count > 0 && library_name == NULL)))
+    {
+        shard_job job;
+        job.kind = enum_states > 0 ? SHARD_ENUMERATE : SHARD_RANDOM;
+        job.states = enum_states > 0 ? enum_states : rule_states;
+        job.symbols = enum_states > 0 ? enum_symbols : rule_symbols;
+        job.max_steps = max_steps;
+        job.seed = enum_states > 0 ? 0 : random_seed;
+        job.count = enum_states > 0 ? 0 : batch_count;
+        job.dedup = dedup;
+        job.shard = shard;
+        job.shards = shards;
+        return runShardJob(job, threads, output_name);
+    }
+    if (shard >= 0)
+    {
+        std::cerr << "--shard is for --enumerate, or --batch of random machines\n";
+        return 1;
+    }
+
+    if (enum_states > 0)
+        return runEnumeration(enum_states, enum_symbols, max_steps, threads, dedup, output_name);
+
+    if ((import_name != NULL || export_name != NULL) && library_name == NULL)
+    {
+        std::cerr << "--import and --export need a --library\n";
+        return 1;
+    }
+    if (import_name != NULL)
+        return runImport(import_name, library_name);
+
+    machine_library library;
+    if (library_name != NULL && !library.open(library_name))
+    {
+        std::cerr << "no machine library at " << library_name << "\n";
+        return 1;
+    }
+    if (export_name != NULL)
+        return runExport(library, export_name);
+
+    if (batch_count > 0)
+        return runBatch(batch_count, max_steps, random_seed, rule_states, rule_symbols, dedup, output_name,
+                        library_name != NULL ? &library : NULL, library_index);
+
+    if (library_name != NULL && !library.load(library_index, machine))
+    {
+        std::cerr << "no machine " << library_index << " in " << library_name
+                  << " (it holds " << library.getCount() << ")\n";
+        return 1;
+    }
+
+    if (accept_name != NULL)
+        return runAccept(machine, accept_name, max_steps, threads, output_name);
+
+    if (bench)
+    {
+        FILE *out = stdout;
+        if (output_name != NULL && (out = fopen(output_name, "w")) == NULL)
+        {
+            std::cerr << "can't write " << output_name << "\n";
+            return 1;
+        }
+        int code = runBenchmarks(out);
+        if (out != stdout)
+            fclose(out);
+        return code;
+    }
+
+    clock_t start = clock();
+    run_result result;
+    decider_result verdict;
+    verdict.kind = VERDICT_UNDECIDED;
+    verdict.loop_start = verdict.period = verdict.shift = 0;
+    if (decide)
+    {
+        verdict = decideMachine(machine, max_steps);
+        result = machine.getResult();
+    }
+    else if (block_size > 0)
+    {
+        macro_engine macro(machine, block_size);
+        result = macro.run(max_steps);
+    }
+    else if (rle)
+    {
+        rle_engine sweeper(machine);
+        result = sweeper.run(max_steps);
+    }
+    else if (hashlife)
+    {
+        hashlife_engine memo(machine);
+        result = memo.run(max_steps);
+    }
+    else if (diagram_name != NULL || trace_name != NULL)
+    {
+        trace_writer trace;
+        if (trace_name != NULL)
+        {
+            if (!trace.open(trace_name, machine, TRACERING, TRACESEGMENT))
+            {
+                std::cerr << "can't write " << trace_name << ".0\n";
+                return 1;
+            }
+            machine.setTracer(&trace);
+        }
+
+        if (diagram_name != NULL)
+        {
+            spacetime_diagram diagram(diagram_width, diagram_height);
+            result = runDiagram(machine, max_steps, diagram, sized);
+            if (!diagram.write(diagram_name))
+            {
+                machine.setTracer(NULL);
+                std::cerr << "can't write " << diagram_name << "\n";
+                return 1;
+            }
+        }
+        else
+        {
+            result = machine.run(max_steps);
+        }
+        machine.setTracer(NULL);
+
+        if (trace.hasFailed())
+        {
+            std::cerr << "can't write the rest of the trace " << trace_name << " (a segment file couldn't be created)\n";
+            return 1;
+        }
+    }
+    else if (sized)
+    {
+        result = runSized(machine, max_steps);
+    }
+    else
+    {
+        result = machine.run(max_steps);
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (random_rules)
+        std::cout << "rules:     " << machine.rulesetString(rule_states, rule_symbols) << "\n";
+    std::cout << "ticks:     " << result.ticks << "\n"
+              << "state:     " << state_char[(int)result.final_state]
+              << (result.halted ? " (halted)" : verdict.kind != VERDICT_UNDECIDED ? " (never halts)" : " (step limit reached)") << "\n"
+              << "tape span: " << result.tape_min << " .. " << result.tape_max
+              << " (" << result.tape_max - result.tape_min + 1 << " cells, "
+              << machine.getTape().getAllocatedCells() << " allocated in "
+              << machine.getTape().getAllocatedBytes() << " bytes)\n";
+    long long first, last;
+    if (machine.getTape().findExtent(first, last))
+    {
+        std::cout << "written:   " << first << " .. " << last << " (" << result.non_blank
+                  << " non-blank cells:";
+        for (int i = 0; i < NUMSYM; ++i)
+        {
+            long long count = machine.getTape().countSymbol((symbol)i);
+            if (i != BLANK && count > 0)
+                std::cout << " " << symbol_char[i] << " " << count;
+        }
+        std::cout << ")\n";
+    }
+    std::cout << "excursion: " << std::max(-result.tape_min, result.tape_max) << " cells from the start\n";
+    // (the macro and hashlife engines don't keep rule hits)
+    if (block_size == 0 && !hashlife && result.ticks > 0)
+    {
+        std::cout << "states:   ";
+        for (int i = 0; i < NUMSTT; ++i)
+        {
+            if (machine.getStateTicks(i) > 0)
+                std::cout << " " << state_char[i] << " " << machine.getStateTicks(i);
+        }
+        std::cout << " (ticks in each)\n";
+    }
+    if (verdict.kind == VERDICT_LOOPS)
+        std::cout << "verdict:   loops with period " << verdict.period << " after "
+                  << verdict.loop_start << " steps\n";
+    if (verdict.kind == VERDICT_TRANSLATES)
+        std::cout << "verdict:   translates " << verdict.shift << " cells every " << verdict.period
+                  << " steps after " << verdict.loop_start << " steps\n";
+    if (verdict.kind == VERDICT_UNREACHABLE)
+        std::cout << "verdict:   none of its halting rules can be reached (not run)\n";
+    if (seconds > 0)
+        std::cout << "steps/sec: " << (long long)(result.ticks / seconds) << "\n";
+
+    if (hits_name != NULL)
+    {
+        FILE *out = fopen(hits_name, "w");
+        if (out == NULL)
+        {
+            std::cerr << "can't write " << hits_name << "\n";
+            return 1;
+        }
+        std::string text = machine.hitsCSV(NUMSTT, NUMSYM);
+        fwrite(text.data(), 1, text.size(), out);
+        fclose(out);
+    }
+
+    return 0;
+}
+
+// Show a recorded trace in the explorer. Returns the program exit code.
+int runReplay(const char *trace_name)
+{
+    trace_reader trace;
+    if (!trace.open(trace_name))
+    {
+        std::cerr << "no trace found at " << trace_name << ".0\n";
+        return 1;
+    }
+
+    initCurses();
+    sim_obj simulation;
+    simulation.runReplay(trace);
+    clear();
+    endwin();
+    return 0;
+}
 
 int main(int argc, char* argv[])
 {
+    if (argc == 3 && std::string(argv[1]) == "--replay")
+        return runReplay(argv[2]);
+
+    // --library on its own opens the explorer with that machine library
+    bool explore_library = argc == 3 && std::string(argv[1]) == "--library";
+
+    // any other command line options select the headless (display free) mode
+    if (argc > 1 && !explore_library)
+        return runHeadless(argc, argv);
+
     // init random number generator
     srand(time(NULL));
 
@@ -41,6 +813,8 @@ int main(int argc, char* argv[])
 
     // create main program class instance
     sim_obj simulation;
+    if (explore_library)
+        simulation.setLibrary(argv[2]);
 
     // run everything
     simulation.runApp();
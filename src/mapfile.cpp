@@ -0,0 +1,135 @@
+#include "mapfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file()
+{
+    base = NULL;
+    length = 0;
+#ifdef _WIN32
+    file_handle = INVALID_HANDLE_VALUE;
+    map_handle = NULL;
+#else
+    fd = -1;
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+// Create (or truncate) a file of the given size and map it for reading and writing
+bool mapped_file::create(const std::string &name, long long bytes)
+{
+    close();
+
+#ifdef _WIN32
+    file_handle = CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return false;
+    map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READWRITE,
+                                    (DWORD)(bytes >> 32), (DWORD)(bytes & 0xFFFFFFFF), NULL);
+    if (map_handle != NULL)
+        base = (unsigned char *)MapViewOfFile(map_handle, FILE_MAP_WRITE, 0, 0, (SIZE_T)bytes);
+#else
+    fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, (off_t)bytes) == 0)
+    {
+        void *p = mmap(NULL, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            base = (unsigned char *)p;
+    }
+#endif
+
+    if (base == NULL)
+    {
+        close();
+        return false;
+    }
+    length = bytes;
+    return true;
+}
+
+// Map an existing file for reading
+bool mapped_file::open(const std::string &name)
+{
+    close();
+
+#ifdef _WIN32
+    file_handle = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file_handle, &file_size) && file_size.QuadPart > 0)
+    {
+        length = file_size.QuadPart;
+        map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (map_handle != NULL)
+            base = (unsigned char *)MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        length = (long long)info.st_size;
+        void *p = mmap(NULL, (size_t)length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+            base = (unsigned char *)p;
+    }
+#endif
+
+    if (base == NULL)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Unmap and close the file (changes are written back by the system)
+void mapped_file::close()
+{
+#ifdef _WIN32
+    if (base != NULL)
+        UnmapViewOfFile(base);
+    if (map_handle != NULL)
+        CloseHandle(map_handle);
+    if (file_handle != INVALID_HANDLE_VALUE)
+        CloseHandle(file_handle);
+    map_handle = NULL;
+    file_handle = INVALID_HANDLE_VALUE;
+#else
+    if (base != NULL)
+        munmap(base, (size_t)length);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+#endif
+    base = NULL;
+    length = 0;
+}
+
+unsigned char *mapped_file::data()
+{
+    return base;
+}
+
+long long mapped_file::size()
+{
+    return length;
+}
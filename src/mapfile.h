@@ -0,0 +1,31 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+// A file mapped into memory (mmap on POSIX systems, a file mapping on Windows)
+
+#include <string>
+
+class mapped_file
+{
+    public:
+        mapped_file();
+        ~mapped_file();
+        bool create(const std::string &,long long);
+        bool open(const std::string &);
+        void close();
+        unsigned char *data();
+        long long size();
+    private:
+        mapped_file(const mapped_file &);
+        mapped_file &operator=(const mapped_file &);
+        unsigned char *base;
+        long long length;
+#ifdef _WIN32
+        void *file_handle;
+        void *map_handle;
+#else
+        int fd;
+#endif
+};
+
+#endif
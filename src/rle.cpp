@@ -0,0 +1,182 @@
+#include "rle.h"
+
+rle_engine::rle_engine(tm_engine &m) : machine(m)
+{
+    head = BLANK;
+    sweeps = 0;
+}
+
+// Number of runs the tape is currently made of (not counting the tape head's cell)
+long long rle_engine::getRunCount()
+{
+    return (long long)(sides[LEFT].size() + sides[RIGHT].size());
+}
+
+// Number of runs skipped over in one go so far
+long long rle_engine::getSweepCount()
+{
+    return sweeps;
+}
+
+// Add cells to the near end of one side of the tape, joining them onto the
+// nearest run if it holds the same symbol. Blanks added to an empty side are
+// dropped, since the tape is blank beyond the runs anyway.
+void rle_engine::pushRun(std::vector<tape_run> &side, symbol sym, long long length)
+{
+    if (side.empty() && sym == BLANK)
+        return;
+
+    if (!side.empty() && side.back().sym == sym)
+    {
+        side.back().length += length;
+        return;
+    }
+
+    tape_run r;
+    r.sym = sym;
+    r.length = length;
+    side.push_back(r);
+}
+
+// Take the nearest cell off one side of the tape
+symbol rle_engine::popCell(std::vector<tape_run> &side)
+{
+    if (side.empty())
+        return BLANK;
+
+    symbol sym = side.back().sym;
+    if (--side.back().length == 0)
+        side.pop_back();
+    return sym;
+}
+
+// Read the machine's tape into runs around the tape head
+void rle_engine::loadTape()
+{
+    tape &t = machine.getTape();
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+
+    sides[LEFT].clear();
+    sides[RIGHT].clear();
+    head = t.getTapeCell(position);
+
+    long long first, last;
+    if (!t.findExtent(first, last))
+        return;
+
+    // (each side is built from its far end inwards, so the nearest run ends up last)
+    for (long long i = first; i < position; ++i)
+        pushRun(sides[LEFT], t.getTapeCell(i), 1);
+    for (long long i = last; i > position; --i)
+        pushRun(sides[RIGHT], t.getTapeCell(i), 1);
+}
+
+// Write the runs back onto the machine's tape
+void rle_engine::storeTape()
+{
+    tape &t = machine.getTape();
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+
+    // (setupTape() keeps the tape's format)
+    t.setupTape();
+    t.setTapeCell(head, position);
+
+    for (int d = LEFT; d <= RIGHT; ++d)
+    {
+        int step = d == LEFT ? -1 : 1;
+        long long cell = position + step;
+
+        for (size_t i = sides[d].size(); i-- > 0; )
+        {
+            const tape_run &r = sides[d][i];
+            // don't allocate tape pages just to write blanks on them
+            if (r.sym != BLANK)
+            {
+                for (long long k = 0; k < r.length; ++k)
+                    t.setTapeCell(r.sym, cell + step * k);
+            }
+            cell += step * r.length;
+        }
+    }
+}
+
+// Run the machine until it halts or max_steps more ticks have passed, a run of the
+// tape at a time where it can. The machine's tape, tape head and tick count end up
+// exactly as if it had been run with tm_engine::run().
+run_result rle_engine::run(long long max_steps)
+{
+    if (machine.isHalted() || max_steps <= 0)
+        return machine.getResult();
+
+    loadTape();
+
+    tape_head &th = machine.getTapeHead();
+    long long position = th.getTapeHeadLoc();
+    state s = th.getCurrentState();
+    long long lo = position, hi = position;
+    long long n = 0;
+
+    while (n < max_steps)
+    {
+        const transition &rule = machine.getRule((int)s, (int)head);
+
+        if (isHaltingState(rule.next_state))
+        {
+            // a halting rule doesn't write, move or count as a tick
+            machine.setHalted(true);
+            machine.setHaltRule(s, head);
+            machine.addHits((int)s, (int)head, 1);
+            s = rule.next_state;
+            break;
+        }
+
+        std::vector<tape_run> &ahead = sides[rule.move_head];
+        std::vector<tape_run> &behind = sides[rule.move_head == LEFT ? RIGHT : LEFT];
+        long long cells = 1;
+
+        if (rule.next_state == s)
+        {
+            // The same rule applies to every cell of the run ahead holding the
+            // tape head's symbol, so the tape head crosses all of them at once.
+            // Past the last run the tape is blank forever.
+            if (!ahead.empty() && ahead.back().sym == head)
+                cells += ahead.back().length;
+            else if (ahead.empty() && head == BLANK)
+                cells = max_steps - n;
+
+            if (cells > max_steps - n)
+                cells = max_steps - n;
+
+            if (cells > 1)
+            {
+                if (!ahead.empty())
+                {
+                    ahead.back().length -= cells - 1;
+                    if (ahead.back().length == 0)
+                        ahead.pop_back();
+                }
+                sweeps++;
+            }
+        }
+
+        machine.addHits((int)s, (int)head, cells);
+        machine.addStateTicks((int)s, cells);
+        pushRun(behind, rule.write_symbol, cells);
+        head = popCell(ahead);
+        position += rule.move_head == LEFT ? -cells : cells;
+        s = rule.next_state;
+        th.setCurrentDirection(rule.move_head);
+        n += cells;
+
+        lo = position < lo ? position : lo;
+        hi = position > hi ? position : hi;
+    }
+
+    th.setTapeHeadLoc(position);
+    th.setCurrentState(s);
+    machine.setTicks(machine.getTicks() + n);
+    machine.extendSpan(lo, hi);
+    storeTape();
+
+    return machine.getResult();
+}
@@ -0,0 +1,45 @@
+#ifndef RLE_H
+#define RLE_H
+
+// Run-length encoded tape with sweep skipping. The tape is held as runs of
+// identical symbols on either side of the tape head. When the rule for the
+// current state and symbol keeps the machine in the same state, every cell of the
+// run ahead of the tape head reads the same symbol and so gets the same rule: the
+// tape head jumps over the whole run in one go (rewriting it) and the run length
+// is added to the tick count. Machines that sweep back and forth over long uniform
+// blocks then take time per run rather than per cell.
+
+#include "engine.h"
+
+// A run of length cells holding the same symbol
+struct tape_run
+{
+    symbol sym;
+    long long length;
+};
+
+class rle_engine
+{
+    public:
+        rle_engine(tm_engine &);
+        run_result run(long long);
+        long long getRunCount();
+        long long getSweepCount();
+    private:
+        void pushRun(std::vector<tape_run> &,symbol,long long);
+        symbol popCell(std::vector<tape_run> &);
+        void loadTape();
+        void storeTape();
+        // The machine being run (its tape, tape head and tick count
+        // are read before the run and written back after it)
+        tm_engine &machine;
+        // runs left of the tape head (sides[LEFT]) and right of it (sides[RIGHT]),
+        // nearest the tape head last; everything beyond them is blank
+        std::vector<tape_run> sides[2];
+        // the cell under the tape head
+        symbol head;
+        // number of times the tape head has jumped over more than one cell
+        long long sweeps;
+};
+
+#endif
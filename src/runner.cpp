@@ -0,0 +1,173 @@
+#include "runner.h"
+#include <chrono>
+
+sim_runner::sim_runner()
+{
+    past = NULL;
+    rate = 0;
+    recording = false;
+    stopping = false;
+    running = false;
+}
+
+sim_runner::~sim_runner()
+{
+    if (worker.joinable())
+    {
+        stopping = true;
+        worker.join();
+    }
+}
+
+// Start running a copy of a machine (recording into a history) at a number of steps
+// per second, 0 being as fast as possible
+void sim_runner::start(tm_engine &m, history &h, long long steps_per_sec)
+{
+    machine = m;
+    past = &h;
+    rate = steps_per_sec;
+    recording = true;
+    stopping = false;
+    running = true;
+    publish();
+    worker = std::thread(&sim_runner::work, this);
+}
+
+// Stop running (if the machine hasn't halted already) and copy the machine back
+void sim_runner::stop(tm_engine &m)
+{
+    stopping = true;
+    if (worker.joinable())
+        worker.join();
+
+    // apply edits that arrived after the runner's last look at the queue
+    sim_command c;
+    while (commands.pop(c))
+        apply(c);
+    if (!recording)
+        past->restart(machine);
+
+    m = machine;
+}
+
+// False once the machine has halted (or the runner has been stopped)
+bool sim_runner::isRunning()
+{
+    return running;
+}
+
+// Copy out the latest snapshot
+void sim_runner::getSnapshot(sim_snapshot &s)
+{
+    std::lock_guard<std::mutex> guard(snapshot_lock);
+    s = latest;
+}
+
+// Send an edit to the running machine (from the display thread)
+void sim_runner::post(const sim_command &c)
+{
+    // the runner empties the queue at least once a batch, so a full queue is only ever brief
+    while (!commands.push(c))
+        std::this_thread::yield();
+}
+
+// Apply an edit to the machine
+void sim_runner::apply(const sim_command &c)
+{
+    switch (c.kind)
+    {
+        case COMMAND_RULE:
+            machine.setRule(c.row, c.col, c.rule);
+            break;
+        case COMMAND_CELL:
+            machine.getTape().setTapeCell(c.sym, c.position);
+            break;
+        case COMMAND_HEAD:
+            machine.getTapeHead().setTapeHeadLoc(c.position);
+            break;
+        case COMMAND_RATE:
+            rate = c.position;
+            return;
+    }
+
+    // the history was for the machine before the edit
+    past->restart(machine);
+    recording = true;
+}
+
+// Make a snapshot of the machine for the display
+void sim_runner::publish()
+{
+    sim_snapshot s;
+    s.ticks = machine.getTicks();
+    s.position = machine.getTapeHead().getTapeHeadLoc();
+    s.current_state = machine.getTapeHead().getCurrentState();
+    s.halted = machine.isHalted();
+    for (int i = 0; i < RUNNERVIEW; ++i)
+        s.view[i] = machine.getTape().getTapeCell(s.position - RUNNERVIEW / 2 + i);
+    for (int i = 0; i < NUMSTT; ++i)
+        for (int j = 0; j < NUMSYM; ++j)
+            s.hits[i * NUMSYM + j] = machine.getHits(i, j);
+    for (int i = 0; i < NUMSTT; ++i)
+        s.state_ticks[i] = machine.getStateTicks(i);
+    for (int i = 0; i < NUMSYM; ++i)
+        s.symbols[i] = machine.getTape().countSymbol((symbol)i);
+    run_result now = machine.getResult();
+    s.tape_min = now.tape_min;
+    s.tape_max = now.tape_max;
+
+    std::lock_guard<std::mutex> guard(snapshot_lock);
+    latest = s;
+}
+
+// The runner thread: take edits, run a batch of steps, publish a snapshot, repeat
+void sim_runner::work()
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point paced_since = clock::now();
+    long long paced_ticks = machine.getTicks();
+    long long paced_rate = rate;
+
+    while (!stopping && !machine.isHalted())
+    {
+        sim_command c;
+        while (commands.pop(c))
+            apply(c);
+
+        if (rate == 0)
+        {
+            // as fast as possible: straight through run(), without recording
+            // (the history starts again from wherever the machine is stopped)
+            machine.run(RUNNERCHUNK);
+            recording = false;
+        }
+        else
+        {
+            if (!recording)
+            {
+                past->restart(machine);
+                recording = true;
+            }
+
+            // catch up with the number of ticks due by now at this rate
+            if (rate != paced_rate)
+            {
+                paced_since = clock::now();
+                paced_ticks = machine.getTicks();
+                paced_rate = rate;
+            }
+            double seconds = std::chrono::duration<double>(clock::now() - paced_since).count();
+            long long due = paced_ticks + (long long)(seconds * rate);
+            long long n = 0;
+            while (machine.getTicks() < due && n < RUNNERCHUNK && past->step(machine))
+                n++;
+            if (n == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        publish();
+    }
+
+    publish();
+    running = false;
+}
@@ -0,0 +1,124 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+// Runs a machine on its own thread, so that it can go as fast as it likes while the
+// display shows it at a steady frame rate. The display thread never touches the running
+// machine: it reads snapshots the runner publishes, and sends its edits through a
+// lock-free queue that the runner drains between batches of steps.
+
+#include "engine.h"
+#include "history.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Cells around the tape head in a snapshot (at least the width of the window)
+#define RUNNERVIEW 128
+// Steps run at full speed between checks for edits and snapshots
+#define RUNNERCHUNK (1 << 18)
+// Room in the edit queue
+#define RUNNERQUEUE 256
+
+// What the display needs to draw the running machine
+struct sim_snapshot
+{
+    long long ticks;
+    long long position;
+    state current_state;
+    bool halted;
+    // the cells from position - RUNNERVIEW / 2
+    symbol view[RUNNERVIEW];
+    // how often each rule has been used (see tm_engine::getHits())
+    long long hits[NUMSTT * NUMSYM];
+    // ticks spent in each state (see tm_engine::getStateTicks())
+    long long state_ticks[NUMSTT];
+    // cells holding each symbol (see tape::countSymbol()), and the tape span
+    long long symbols[NUMSYM];
+    long long tape_min;
+    long long tape_max;
+};
+
+// An edit made to the running machine from the display
+enum command_kind
+{
+    COMMAND_RULE,  // replace the rule for (row, col) with rule
+    COMMAND_CELL,  // write sym at position
+    COMMAND_HEAD,  // move the tape head to position
+    COMMAND_RATE   // run at position steps per second (0 for as fast as possible)
+};
+
+struct sim_command
+{
+    command_kind kind;
+    int row;
+    int col;
+    transition rule;
+    long long position;
+    symbol sym;
+};
+
+// Single producer, single consumer ring of commands: the producer only writes tail and
+// the consumer only writes head, so neither ever waits for the other.
+class command_queue
+{
+    public:
+        command_queue() : head(0), tail(0) {}
+
+        // Returns false if the queue is full
+        bool push(const sim_command &c)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == RUNNERQUEUE)
+                return false;
+            ring[t % RUNNERQUEUE] = c;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Returns false if the queue is empty
+        bool pop(sim_command &c)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return false;
+            c = ring[h % RUNNERQUEUE];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    private:
+        sim_command ring[RUNNERQUEUE];
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+};
+
+class sim_runner
+{
+    public:
+        sim_runner();
+        ~sim_runner();
+        void start(tm_engine &,history &,long long);
+        void stop(tm_engine &);
+        bool isRunning();
+        void getSnapshot(sim_snapshot &);
+        void post(const sim_command &);
+    private:
+        void work();
+        void apply(const sim_command &);
+        void publish();
+        // the running machine (only touched by the runner thread while it runs)
+        tm_engine machine;
+        history *past;
+        // steps per second (0 for as fast as possible)
+        long long rate;
+        // true while the history is being recorded (it isn't at full speed)
+        bool recording;
+        std::thread worker;
+        std::atomic<bool> stopping;
+        std::atomic<bool> running;
+        command_queue commands;
+        // the latest snapshot
+        std::mutex snapshot_lock;
+        sim_snapshot latest;
+};
+
+#endif
@@ -0,0 +1,347 @@
+#include "search.h"
+#include "decider.h"
+#include <algorithm>
+#include <thread>
+
+// Results are written out in chunks of about this many bytes per worker
+#define OUTPUTCHUNK 65536
+
+tnf_search::tnf_search(int states, int symbols, long long limit, int threads)
+{
+    num_states = states;
+    num_symbols = symbols;
+    step_limit = limit;
+    // use every core unless told otherwise
+    num_threads = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    if (num_threads < 1)
+        num_threads = 1;
+    seen = NULL;
+}
+
+// Skip machines that are the same as one already run (renamed or mirrored, see
+// canonicalize()). A skipped machine's whole subtree is skipped with it, since it is
+// the same as the other machine's subtree.
+void tnf_search::setDedup(dedup_set *set)
+{
+    seen = set;
+}
+
+// Enumerate every TNF rule-set of the search's size, writing one line per machine to out:
+//   halt <ticks> <rules>    the machine halts after <ticks> ticks
+//   loops <period> <tick> <rules>
+//                           the machine repeats a configuration forever, every <period>
+//                           ticks from tick <tick> on
+//   translates <period> <shift> <tick> <rules>
+//                           the machine repeats a configuration forever, shifted by
+//                           <shift> cells every <period> ticks, from tick <tick> on
+//   unreachable <rules>     none of the machine's halting rules can ever be reached
+//                           (it isn't run)
+//   undecided <rules>       the machine was still running at the step limit
+// Returns the totals once the whole tree has been explored.
+search_totals tnf_search::run(FILE *out)
+{
+    return run(out, rootNode());
+}
+
+// The same for the subtree under one node (the node itself included)
+search_totals tnf_search::run(FILE *out, const tnf_node &root)
+{
+    output = out;
+    clearTotals(totals);
+
+    for (int i = 0; i < num_threads; ++i)
+        queues.push_back(new work_queue);
+
+    pending = 0;
+    pushWork(0, root);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i)
+        threads.push_back(std::thread(&tnf_search::worker, this, i));
+    for (int i = 0; i < num_threads; ++i)
+        threads[i].join();
+
+    for (int i = 0; i < num_threads; ++i)
+        delete queues[i];
+    queues.clear();
+
+    return totals;
+}
+
+// Split the tree into subtrees that can be searched separately, always the same way:
+// nodes are run breadth first, on this thread, until at least count nodes are waiting
+// to be run (or the tree runs out). The results of the nodes run are written to out
+// (if it isn't NULL) and counted in done, and the nodes waiting are returned in order.
+std::vector<tnf_node> tnf_search::split(size_t count, FILE *out, search_totals &done)
+{
+    output = out;
+    clearTotals(totals);
+
+    std::deque<tnf_node> waiting;
+    waiting.push_back(rootNode());
+    tm_engine machine;
+    std::string buffer;
+    search_totals local;
+    clearTotals(local);
+
+    while (!waiting.empty() && waiting.size() < count)
+    {
+        children.clear();
+        runNode(-1, machine, waiting.front(), buffer, local);
+        waiting.pop_front();
+        waiting.insert(waiting.end(), children.begin(), children.end());
+    }
+    children.clear();
+
+    flushOutput(buffer, local);
+    done = totals;
+    return std::vector<tnf_node>(waiting.begin(), waiting.end());
+}
+
+// The root of the tree: nothing defined yet, only state a and the blank symbol in use
+tnf_node tnf_search::rootNode()
+{
+    tnf_node root;
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            root.defined[i][j] = false;
+            root.rules[i][j].curr_state = (state)i;
+            root.rules[i][j].curr_symbol = (symbol)j;
+            root.rules[i][j].next_state = STATE_QHALT;
+            root.rules[i][j].write_symbol = BLANK;
+            root.rules[i][j].move_head = LEFT;
+        }
+    }
+    root.max_state = 0;
+    root.max_symbol = 0;
+    return root;
+}
+
+// Add a node to the back of a worker's queue (worker -1 is split(), which keeps its
+// own list)
+void tnf_search::pushWork(int w, const tnf_node &node)
+{
+    if (w < 0)
+    {
+        children.push_back(node);
+        return;
+    }
+    pending++;
+    std::lock_guard<std::mutex> guard(queues[w]->lock);
+    queues[w]->nodes.push_back(node);
+}
+
+// Get the next node for a worker: the newest node of its own queue (depth first, so
+// the queues stay small), otherwise the oldest node of another worker's queue (the
+// biggest unexplored subtrees). Returns false if there is nothing to take right now.
+bool tnf_search::takeWork(int w, tnf_node &node)
+{
+    for (int i = 0; i < num_threads; ++i)
+    {
+        work_queue &q = *queues[(w + i) % num_threads];
+        std::lock_guard<std::mutex> guard(q.lock);
+
+        if (q.nodes.empty())
+            continue;
+
+        if (i == 0)
+        {
+            node = q.nodes.back();
+            q.nodes.pop_back();
+        }
+        else
+        {
+            node = q.nodes.front();
+            q.nodes.pop_front();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+// Worker thread: run nodes (with its own engine) until the whole tree has been explored
+void tnf_search::worker(int w)
+{
+    tm_engine machine;
+    tnf_node node;
+    std::string buffer;
+    search_totals local;
+    clearTotals(local);
+
+    while (pending > 0)
+    {
+        if (!takeWork(w, node))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        runNode(w, machine, node, buffer, local);
+        if (buffer.size() >= OUTPUTCHUNK)
+            flushOutput(buffer, local);
+
+        // children (if any) have been pushed, so this node is done
+        pending--;
+    }
+
+    flushOutput(buffer, local);
+}
+
+// Run one node, adding its result line to buffer and counting it in local. The
+// children of a machine that halts are pushed onto worker w's queue.
+void tnf_search::runNode(int w, tm_engine &machine, const tnf_node &node, std::string &buffer, search_totals &local)
+{
+    if (seen != NULL)
+    {
+        canonical_form form;
+        canonicalize(node.rules, form);
+        if (!seen->insert(form))
+        {
+            local.duplicates++;
+            return;
+        }
+    }
+
+    machine.reset();
+    loadNode(machine, node);
+    // running the machine under the deciders drops machines that loop
+    // as soon as the loop is noticed
+    decider_result verdict = decideMachine(machine, step_limit);
+    run_result result = machine.getResult();
+    local.machines++;
+
+    if (result.halted)
+    {
+        // Only undefined rules halt. This machine is a leaf of the tree as it stands,
+        // and its children are the ways of filling in the rule that was reached.
+        std::string rules = machine.rulesetString(num_states, num_symbols);
+        char line[64];
+        snprintf(line, sizeof(line), "halt %lld ", result.ticks);
+        buffer += line;
+        buffer += rules;
+        buffer += '\n';
+        local.halted++;
+        if (result.ticks > local.champion_ticks)
+        {
+            local.champion_ticks = result.ticks;
+            local.champion_rules = rules;
+        }
+
+        expand(w, machine, node);
+    }
+    else if (verdict.kind == VERDICT_LOOPS || verdict.kind == VERDICT_TRANSLATES)
+    {
+        char line[96];
+        if (verdict.kind == VERDICT_LOOPS)
+            snprintf(line, sizeof(line), "loops %lld %lld ", verdict.period, verdict.loop_start);
+        else
+            snprintf(line, sizeof(line), "translates %lld %lld %lld ", verdict.period, verdict.shift, verdict.loop_start);
+        buffer += line;
+        buffer += machine.rulesetString(num_states, num_symbols);
+        buffer += '\n';
+        local.looping++;
+    }
+    else if (verdict.kind == VERDICT_UNREACHABLE)
+    {
+        buffer += "unreachable ";
+        buffer += machine.rulesetString(num_states, num_symbols);
+        buffer += '\n';
+        local.looping++;
+    }
+    else
+    {
+        buffer += "undecided ";
+        buffer += machine.rulesetString(num_states, num_symbols);
+        buffer += '\n';
+        local.undecided++;
+    }
+}
+
+// Push the children of a node that halted on an undefined rule: every way of filling
+// in that rule with a non-halting rule, using at most one new state and one new symbol.
+void tnf_search::expand(int w, tm_engine &machine, const tnf_node &node)
+{
+    run_result result = machine.getResult();
+    int s = (int)result.halt_rule_state;
+    int y = (int)result.halt_rule_symbol;
+
+    // If this was the last undefined rule, filling it in leaves no way to halt
+    int undefined = 0;
+    for (int i = 0; i < num_states; ++i)
+        for (int j = 0; j < num_symbols; ++j)
+            if (!node.defined[i][j])
+                undefined++;
+    if (undefined <= 1)
+        return;
+
+    int last_state = std::min(node.max_state + 1, num_states - 1);
+    int last_symbol = std::min(node.max_symbol + 1, num_symbols - 1);
+    // Mirror images (every direction swapped) behave the same, so the very first rule
+    // only ever moves right
+    bool first_rule = node.max_state == 0 && node.max_symbol == 0 && undefined == num_states * num_symbols;
+
+    for (int next = 0; next <= last_state; ++next)
+    {
+        for (int write = 0; write <= last_symbol; ++write)
+        {
+            for (int dir = first_rule ? 1 : 0; dir < 2; ++dir)
+            {
+                tnf_node child = node;
+                child.defined[s][y] = true;
+                child.rules[s][y].next_state = (state)next;
+                child.rules[s][y].write_symbol = (symbol)write;
+                child.rules[s][y].move_head = (direction)dir;
+                child.max_state = std::max(node.max_state, next);
+                child.max_symbol = std::max(node.max_symbol, write);
+                pushWork(w, child);
+            }
+        }
+    }
+}
+
+// Copy a node's rules into an engine (undefined rules halt)
+void tnf_search::loadNode(tm_engine &machine, const tnf_node &node)
+{
+    for (int i = 0; i < NUMSTT; ++i)
+        for (int j = 0; j < NUMSYM; ++j)
+            machine.setRule(i, j, node.rules[i][j]);
+}
+
+// Write a worker's buffered results and add its counts to the totals
+void tnf_search::flushOutput(std::string &buffer, search_totals &local)
+{
+    std::lock_guard<std::mutex> guard(output_lock);
+
+    if (output != NULL)
+        fwrite(buffer.data(), 1, buffer.size(), output);
+    buffer.clear();
+
+    addTotals(totals, local);
+    local.machines = local.halted = local.looping = local.undecided = local.duplicates = 0;
+}
+
+// Start totals at nothing found
+void clearTotals(search_totals &t)
+{
+    t.machines = t.halted = t.looping = t.undecided = t.duplicates = 0;
+    t.champion_ticks = -1;
+    t.champion_rules.clear();
+}
+
+// Add the counts of one part of a search to the totals (keeping the better champion)
+void addTotals(search_totals &t, const search_totals &part)
+{
+    t.machines += part.machines;
+    t.halted += part.halted;
+    t.looping += part.looping;
+    t.undecided += part.undecided;
+    t.duplicates += part.duplicates;
+    if (part.champion_ticks > t.champion_ticks)
+    {
+        t.champion_ticks = part.champion_ticks;
+        t.champion_rules = part.champion_rules;
+    }
+}
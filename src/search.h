@@ -0,0 +1,88 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// Busy-beaver style enumeration of rule-sets in tree normal form (TNF).
+// A rule-set starts out with every rule undefined, and a rule is only filled in
+// the first time the machine actually reaches it, so rule-sets that differ only in
+// rules that are never used are never generated twice. New states and symbols are
+// introduced in order, which removes most relabelings of the same machine.
+// The tree is explored by a pool of worker threads that steal work from each other.
+
+#include "engine.h"
+#include "canon.h"
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+// A partially defined rule-set: a node of the TNF tree
+struct tnf_node
+{
+    transition rules[NUMSTT][NUMSYM];
+    // which rules have been filled in
+    bool defined[NUMSTT][NUMSYM];
+    // highest state and symbol used by a defined rule so far
+    int max_state;
+    int max_symbol;
+};
+
+// Totals for a finished (or running) search
+struct search_totals
+{
+    long long machines;
+    long long halted;
+    // proven never to halt (by any decider)
+    long long looping;
+    long long undecided;
+    // skipped without being run, as the same as a machine already run (see dedup_set)
+    long long duplicates;
+    // longest running halting machine found
+    long long champion_ticks;
+    std::string champion_rules;
+};
+
+void clearTotals(search_totals &);
+void addTotals(search_totals &,const search_totals &);
+
+class tnf_search
+{
+    public:
+        tnf_search(int,int,long long,int);
+        search_totals run(FILE *);
+        search_totals run(FILE *,const tnf_node &);
+        std::vector<tnf_node> split(size_t,FILE *,search_totals &);
+        tnf_node rootNode();
+        void setDedup(dedup_set *);
+    private:
+        // One worker thread's queue of TNF nodes still to be run
+        struct work_queue
+        {
+            std::mutex lock;
+            std::deque<tnf_node> nodes;
+        };
+        void worker(int);
+        void runNode(int,tm_engine &,const tnf_node &,std::string &,search_totals &);
+        bool takeWork(int,tnf_node &);
+        void pushWork(int,const tnf_node &);
+        void expand(int,tm_engine &,const tnf_node &);
+        void loadNode(tm_engine &,const tnf_node &);
+        void flushOutput(std::string &,search_totals &);
+        int num_states;
+        int num_symbols;
+        long long step_limit;
+        int num_threads;
+        std::vector<work_queue *> queues;
+        // TNF nodes pushed but not yet finished; the search is over when this reaches 0
+        std::atomic<long long> pending;
+        // children pushed while split() runs a node
+        std::vector<tnf_node> children;
+        // canonical forms of the machines run so far (NULL to run every machine)
+        dedup_set *seen;
+        // where results are streamed, and the totals so far
+        FILE *output;
+        std::mutex output_lock;
+        search_totals totals;
+};
+
+#endif
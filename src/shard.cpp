@@ -0,0 +1,357 @@
+#include "shard.h"
+#include "batch.h"
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+// Make sure what has been written to a file is on the disk
+static bool syncFile(FILE *f)
+{
+    if (fflush(f) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Rename a file over another in one step (the other is either still there, or replaced)
+static bool replaceFile(const std::string &from, const std::string &to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Cut an open file down to a length, and go to its end
+static bool cutFile(FILE *f, long long bytes)
+{
+#ifdef _WIN32
+    return _chsize_s(_fileno(f), bytes) == 0 && _fseeki64(f, bytes, SEEK_SET) == 0;
+#else
+    return ftruncate(fileno(f), (off_t)bytes) == 0 && fseeko(f, (off_t)bytes, SEEK_SET) == 0;
+#endif
+}
+
+static long long fileOffset(FILE *f)
+{
+#ifdef _WIN32
+    return _ftelli64(f);
+#else
+    return (long long)ftello(f);
+#endif
+}
+
+static const char *kind_names[] = {"enumerate", "random"};
+
+// Save a checkpoint: written to a temporary file first, which then replaces the old
+// checkpoint, so that a crash at any point leaves one whole checkpoint behind.
+// Returns false if it couldn't be written.
+bool writeCheckpoint(const std::string &name, const shard_checkpoint &cp)
+{
+    std::string temp = name + ".tmp";
+    FILE *f = fopen(temp.c_str(), "w");
+    if (f == NULL)
+        return false;
+
+    const shard_job &job = cp.job;
+    fprintf(f, "tmcheckpoint 1\n"
+               "kind %s\nstates %d\nsymbols %d\nsteps %lld\nseed %llu\ncount %lld\ndedup %d\n"
+               "shard %d\nshards %d\n"
+               "cursor %lld\noutput %lld\n"
+               "machines %lld\nhalted %lld\nlooping %lld\nundecided %lld\nduplicates %lld\n"
+               "champion_ticks %lld\nchampion_rules %s\n"
+               "done %d\n",
+            kind_names[job.kind], job.states, job.symbols, job.max_steps, job.seed, job.count, job.dedup ? 1 : 0,
+            job.shard, job.shards,
+            cp.cursor, cp.output_bytes,
+            cp.totals.machines, cp.totals.halted, cp.totals.looping, cp.totals.undecided, cp.totals.duplicates,
+            cp.totals.champion_ticks, cp.totals.champion_rules.c_str(),
+            cp.done ? 1 : 0);
+
+    bool ok = syncFile(f);
+    ok = fclose(f) == 0 && ok;
+    return ok && replaceFile(temp, name);
+}
+
+// Read a checkpoint. Returns false if there is none (or it isn't one).
+bool readCheckpoint(const std::string &name, shard_checkpoint &cp)
+{
+    FILE *f = fopen(name.c_str(), "r");
+    if (f == NULL)
+        return false;
+
+    char line[1024];
+    int fields = 0;
+    bool valid = fgets(line, sizeof(line), f) != NULL && strcmp(line, "tmcheckpoint 1\n") == 0;
+    clearTotals(cp.totals);
+
+    while (valid && fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *value = strchr(line, ' ');
+        if (value == NULL)
+            continue;
+        *value++ = '\0';
+        std::string key = line;
+        long long n = atoll(value);
+        fields++;
+
+        if (key == "kind")
+            cp.job.kind = strcmp(value, kind_names[SHARD_RANDOM]) == 0 ? SHARD_RANDOM : SHARD_ENUMERATE;
+        else if (key == "states")
+            cp.job.states = (int)n;
+        else if (key == "symbols")
+            cp.job.symbols = (int)n;
+        else if (key == "steps")
+            cp.job.max_steps = n;
+        else if (key == "seed")
+            cp.job.seed = strtoull(value, NULL, 10);
+        else if (key == "count")
+            cp.job.count = n;
+        else if (key == "dedup")
+            cp.job.dedup = n != 0;
+        else if (key == "shard")
+            cp.job.shard = (int)n;
+        else if (key == "shards")
+            cp.job.shards = (int)n;
+        else if (key == "cursor")
+            cp.cursor = n;
+        else if (key == "output")
+            cp.output_bytes = n;
+        else if (key == "machines")
+            cp.totals.machines = n;
+        else if (key == "halted")
+            cp.totals.halted = n;
+        else if (key == "looping")
+            cp.totals.looping = n;
+        else if (key == "undecided")
+            cp.totals.undecided = n;
+        else if (key == "duplicates")
+            cp.totals.duplicates = n;
+        else if (key == "champion_ticks")
+            cp.totals.champion_ticks = n;
+        else if (key == "champion_rules")
+            cp.totals.champion_rules = value;
+        else if (key == "done")
+            cp.done = n != 0;
+        else
+            fields--;
+    }
+
+    fclose(f);
+    // (every field is written every time)
+    return valid && fields == 19;
+}
+
+// True if two jobs are the same search, apart from which shard they are
+static bool sameSearch(const shard_job &a, const shard_job &b)
+{
+    return a.kind == b.kind && a.states == b.states && a.symbols == b.symbols && a.max_steps == b.max_steps &&
+           a.seed == b.seed && a.count == b.count && a.dedup == b.dedup && a.shards == b.shards;
+}
+
+// A shard being run: its checkpoint as it stands, and where it is saved
+struct shard_progress
+{
+    std::string checkpoint_name;
+    shard_checkpoint cp;
+    FILE *out;
+    std::chrono::steady_clock::time_point saved;
+};
+
+// Save a checkpoint now (with the output as it is so far on the disk first)
+static bool saveProgress(shard_progress &p)
+{
+    p.saved = std::chrono::steady_clock::now();
+    if (!syncFile(p.out))
+        return false;
+    p.cp.output_bytes = fileOffset(p.out);
+    return writeCheckpoint(p.checkpoint_name, p.cp);
+}
+
+// Save a checkpoint if CHECKPOINTSECONDS have passed since the last one
+static bool saveIfDue(shard_progress &p)
+{
+    if (std::chrono::steady_clock::now() - p.saved < std::chrono::seconds(CHECKPOINTSECONDS))
+        return true;
+    return saveProgress(p);
+}
+
+// Run the units of an enumeration that belong to the shard, from the checkpoint's cursor
+static bool runEnumerationShard(const shard_job &job, int threads, bool resumed, shard_progress &p)
+{
+    dedup_set seen;
+    tnf_search search(job.states, job.symbols, job.max_steps, threads);
+    if (job.dedup)
+        search.setDedup(&seen);
+
+    // Every shard splits the tree (the same way), and shard 0 keeps the results of the
+    // nodes it ran to do so
+    search_totals top;
+    bool keep_top = job.shard == 0 && !resumed;
+    std::vector<tnf_node> units = search.split(SHARDUNITS, keep_top ? p.out : NULL, top);
+    if (keep_top)
+    {
+        addTotals(p.cp.totals, top);
+        if (!saveProgress(p))
+            return false;
+    }
+
+    for (long long u = p.cp.cursor; u < (long long)units.size(); u += job.shards)
+    {
+        addTotals(p.cp.totals, search.run(p.out, units[(size_t)u]));
+        p.cp.cursor = u + job.shards;
+        if (!saveIfDue(p))
+            return false;
+    }
+    return true;
+}
+
+// Run the machine numbers of a random search that belong to the shard, from the
+// checkpoint's cursor, SHARDBATCH at a time
+static bool runRandomShard(const shard_job &job, shard_progress &p)
+{
+    long long end = job.count / job.shards * (job.shard + 1) + std::min((long long)job.shard + 1, job.count % job.shards);
+    dedup_set seen;
+
+    while (p.cp.cursor < end)
+    {
+        long long n = std::min((long long)SHARDBATCH, end - p.cp.cursor);
+        {
+            // (the results are all written out once machines is gone)
+            triage_batch machines(n, p.out);
+            machines.setSize(job.states, job.symbols);
+            machines.setSeed(job.seed, p.cp.cursor);
+            if (job.dedup)
+                machines.setDedup(&seen);
+            batch_engine batch(job.max_steps);
+            batch.run(machines);
+            addTotals(p.cp.totals, machines.getTotals());
+        }
+        p.cp.cursor += n;
+        if (!saveIfDue(p))
+            return false;
+    }
+    return true;
+}
+
+// Run one shard of a search, writing its results to output_name (and its checkpoints
+// beside it), or carry on from its checkpoint if there is one. totals is set to the
+// shard's totals once it has finished.
+shard_status runShard(const shard_job &job, int threads, const std::string &output_name, search_totals &totals)
+{
+    shard_progress p;
+    p.checkpoint_name = output_name + CHECKPOINTSUFFIX;
+    p.saved = std::chrono::steady_clock::now();
+    shard_checkpoint &cp = p.cp;
+    bool resumed = readCheckpoint(p.checkpoint_name, cp);
+
+    if (resumed)
+    {
+        if (!sameSearch(cp.job, job) || cp.job.shard != job.shard)
+            return SHARD_OTHER_JOB;
+        // (anything written after the checkpoint is written again)
+        p.out = fopen(output_name.c_str(), "r+b");
+        if (p.out != NULL && !cutFile(p.out, cp.output_bytes))
+        {
+            fclose(p.out);
+            p.out = NULL;
+        }
+    }
+    else
+    {
+        cp.job = job;
+        cp.output_bytes = 0;
+        clearTotals(cp.totals);
+        cp.done = false;
+        // the first unit of the shard
+        if (job.kind == SHARD_ENUMERATE)
+            cp.cursor = job.shard;
+        else
+            cp.cursor = job.count / job.shards * job.shard + std::min((long long)job.shard, job.count % job.shards);
+        p.out = fopen(output_name.c_str(), "wb");
+    }
+    if (p.out == NULL)
+        return SHARD_NO_OUTPUT;
+
+    bool ok = true;
+    if (!cp.done)
+    {
+        if (job.kind == SHARD_ENUMERATE)
+            ok = runEnumerationShard(job, threads, resumed, p);
+        else
+            ok = runRandomShard(job, p);
+        cp.done = ok;
+        ok = ok && saveProgress(p);
+    }
+
+    fclose(p.out);
+    totals = cp.totals;
+    return ok ? SHARD_OK : SHARD_NO_OUTPUT;
+}
+
+// Write the results of finished shards (given by their output files) to out, one after
+// another, and add up their totals. Every shard of the search has to be there, once.
+// On failure, problem is set to the file at fault.
+shard_status mergeShards(const std::vector<std::string> &names, FILE *out, search_totals &totals, std::string &problem)
+{
+    std::vector<shard_checkpoint> checkpoints(names.size());
+    std::vector<bool> present;
+    clearTotals(totals);
+
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        shard_checkpoint &cp = checkpoints[i];
+        problem = names[i];
+        if (!readCheckpoint(names[i] + CHECKPOINTSUFFIX, cp) || !cp.done)
+            return SHARD_UNFINISHED;
+        if (!sameSearch(cp.job, checkpoints[0].job) || cp.job.shard < 0 || cp.job.shard >= cp.job.shards)
+            return SHARD_OTHER_JOB;
+        present.resize((size_t)cp.job.shards, false);
+        if (present[(size_t)cp.job.shard])
+            return SHARD_OTHER_JOB;
+        present[(size_t)cp.job.shard] = true;
+    }
+    problem.clear();
+    if (names.empty() || names.size() != present.size())
+        return SHARD_UNFINISHED;
+
+    std::vector<char> chunk(1 << 16);
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        problem = names[i];
+        FILE *in = fopen(names[i].c_str(), "rb");
+        if (in == NULL)
+            return SHARD_NO_OUTPUT;
+
+        // only what the checkpoint counts
+        long long left = checkpoints[i].output_bytes;
+        while (left > 0)
+        {
+            size_t n = fread(&chunk[0], 1, (size_t)std::min(left, (long long)chunk.size()), in);
+            if (n == 0 || fwrite(&chunk[0], 1, n, out) != n)
+                break;
+            left -= (long long)n;
+        }
+        fclose(in);
+        if (left > 0)
+            return SHARD_NO_OUTPUT;
+
+        addTotals(totals, checkpoints[i].totals);
+    }
+    problem.clear();
+    return SHARD_OK;
+}
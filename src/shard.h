@@ -0,0 +1,80 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+// Long searches split into shards that separate processes can run, and that survive
+// being stopped. A search is cut into units the same way every time: the TNF tree into
+// the subtrees left after running its top nodes breadth first (see tnf_search::split()),
+// a seeded random search into stretches of SHARDBATCH machine numbers. Shard k of n
+// takes units k, k + n, k + 2n ... of an enumeration, or the k-th of n equal runs of
+// machine numbers of a random search.
+//
+// A shard writes its results to its output file as usual, and every CHECKPOINTSECONDS
+// (between units) it saves a checkpoint next to it: the next unit to run, the totals so
+// far and how long the output was at that point. The checkpoint is written to a
+// temporary file and renamed over the old one, so there is always one whole checkpoint
+// on disk. Started again, a shard cuts the output back to the checkpointed length (the
+// undecided machines, and every other result, up to there) and carries on from the next
+// unit. mergeShards() puts the outputs of finished shards together.
+
+#include "search.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Subtrees an enumeration is split into (at least, if the tree is that big)
+#define SHARDUNITS 1024
+// Machine numbers in one unit of a random search
+#define SHARDBATCH 65536
+// Seconds between checkpoints
+#define CHECKPOINTSECONDS 10
+// Added to an output file's name for its checkpoint
+#define CHECKPOINTSUFFIX ".ckpt"
+
+enum shard_kind
+{
+    SHARD_ENUMERATE,  // every TNF machine of a size
+    SHARD_RANDOM      // count seeded random machines of a size
+};
+
+// What a shard is a part of (a checkpoint can only be resumed by the same job)
+struct shard_job
+{
+    shard_kind kind;
+    int states;
+    int symbols;
+    long long max_steps;
+    // the seed and number of machines of a random search
+    unsigned long long seed;
+    long long count;
+    bool dedup;
+    // this shard, and the number of shards
+    int shard;
+    int shards;
+};
+
+struct shard_checkpoint
+{
+    shard_job job;
+    // the next unit to run
+    long long cursor;
+    // bytes of the output file holding the results counted in totals
+    long long output_bytes;
+    search_totals totals;
+    bool done;
+};
+
+// How running or merging shards went
+enum shard_status
+{
+    SHARD_OK,
+    SHARD_NO_OUTPUT,     // the output file can't be written (or read, to merge)
+    SHARD_OTHER_JOB,     // the checkpoint is for another search (or another shard)
+    SHARD_UNFINISHED     // merging: a shard has no checkpoint, or hasn't finished
+};
+
+bool readCheckpoint(const std::string &,shard_checkpoint &);
+bool writeCheckpoint(const std::string &,const shard_checkpoint &);
+shard_status runShard(const shard_job &,int,const std::string &,search_totals &);
+shard_status mergeShards(const std::vector<std::string> &,FILE *,search_totals &,std::string &);
+
+#endif
@@ -0,0 +1,74 @@
+#include "sized.h"
+
+typedef run_result (*sized_run)(tm_engine &, long long);
+
+template <int S, int Y>
+static run_result runAs(tm_engine &machine, long long max_steps)
+{
+    sized_engine<S, Y> engine(machine);
+    return engine.run(max_steps);
+}
+
+// The precompiled sizes, by states and symbols
+static const sized_run sized_runs[SIZEDMAXSTATES - SIZEDMINSTATES + 1][SIZEDMAXSYMBOLS - SIZEDMINSYMBOLS + 1] =
+{
+    {runAs<2, 2>, runAs<2, 3>, runAs<2, 4>},
+    {runAs<3, 2>, runAs<3, 3>, runAs<3, 4>},
+    {runAs<4, 2>, runAs<4, 3>, runAs<4, 4>},
+    {runAs<5, 2>, runAs<5, 3>, runAs<5, 4>},
+    {runAs<6, 2>, runAs<6, 3>, runAs<6, 4>}
+};
+
+// The number of states and symbols a machine needs: those of every rule that isn't the
+// default a/./left (and the states it goes to and symbols it writes), the state the
+// machine is in, and every symbol on its tape
+void neededSize(tm_engine &machine, int &states, int &symbols)
+{
+    states = 1;
+    symbols = 1;
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            const transition &rule = machine.getRule(i, j);
+            if (rule.next_state == STATE_QA && rule.write_symbol == BLANK && rule.move_head == LEFT)
+                continue;
+            states = std::max(states, i + 1);
+            symbols = std::max(symbols, std::max(j, (int)rule.write_symbol) + 1);
+            if (!isHaltingState(rule.next_state))
+                states = std::max(states, (int)rule.next_state + 1);
+        }
+    }
+
+    state current = machine.getTapeHead().getCurrentState();
+    if (!isHaltingState(current))
+        states = std::max(states, (int)current + 1);
+
+    long long first, last;
+    if (machine.getTape().findExtent(first, last))
+    {
+        for (long long p = first; p <= last && symbols < NUMSYM; ++p)
+            symbols = std::max(symbols, (int)machine.getTape().getTapeCell(p) + 1);
+    }
+}
+
+// Run a machine for at most max_steps ticks with the step loop of the smallest
+// precompiled size it fits (NUMSTT * NUMSYM holds every machine). The result is exactly
+// what tm_engine::run() gives. Not for traced machines.
+run_result runSized(tm_engine &machine, long long max_steps)
+{
+    if (machine.isHalted() || max_steps <= 0)
+        return machine.getResult();
+    // a traced machine has to go through run(), which records every step
+    if (machine.getTracer() != NULL)
+        return machine.run(max_steps);
+
+    int states, symbols;
+    neededSize(machine, states, symbols);
+    states = std::max(states, SIZEDMINSTATES);
+    symbols = std::max(symbols, SIZEDMINSYMBOLS);
+
+    if (states > SIZEDMAXSTATES || symbols > SIZEDMAXSYMBOLS)
+        return runAs<NUMSTT, NUMSYM>(machine, max_steps);
+    return sized_runs[states - SIZEDMINSTATES][symbols - SIZEDMINSYMBOLS](machine, max_steps);
+}
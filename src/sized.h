@@ -0,0 +1,305 @@
+#ifndef SIZED_H
+#define SIZED_H
+
+// run() specialised for machines of a given size. tm_engine always steps through
+// NUMSTT * NUMSYM rules and pages of tape; a machine with few states and symbols only
+// needs a table of a few dozen bytes (one or two cache lines), and the number of
+// symbols is then known when the step loop is compiled. The sizes most studied (2 to
+// 6 states with 2 to 4 symbols) and the full NUMSTT * NUMSYM are compiled in, and
+// runSized() picks the smallest that holds a machine at run time.
+//
+// The tape is one run of bytes, and each cell also tells the step loop what it would
+// otherwise check for at every step:
+//   - a cell the tape head has never been above holds its symbol + Y ("fresh"), whose
+//     rules are copies of the symbol's own rules. Once the head has been above a cell
+//     the rule used there has written a plain symbol over it, so the span the head
+//     has covered is found from the first plain cells at either end, after the run,
+//     instead of being tracked at every step.
+//   - the cells at either end hold EDGE, whose rules all "halt": reaching one makes
+//     the tape longer, so the loop never checks whether the head is still on the tape.
+// Results (ticks, state, tape, span, rule hits) are exactly what run() gives.
+
+#include "engine.h"
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+// Cells of tape added beyond each end of what a machine has used, when it starts
+#define SIZEDMARGIN 64
+// Smallest and largest sizes compiled in besides NUMSTT * NUMSYM
+#define SIZEDMINSTATES 2
+#define SIZEDMAXSTATES 6
+#define SIZEDMINSYMBOLS 2
+#define SIZEDMAXSYMBOLS 4
+
+template <int S, int Y>
+class sized_engine
+{
+    public:
+        sized_engine(tm_engine &);
+        run_result run(long long);
+    private:
+        // a row of the table per state: the Y symbols, their fresh copies, and EDGE
+        enum { ROW = 2 * Y + 1, EDGE = 2 * Y };
+        // halts value of an EDGE rule
+        enum { GROW = 2 };
+        void load();
+        void store(unsigned char *,bool);
+        unsigned char *grow(unsigned char *);
+        long long walk(unsigned char *&,size_t &,const compiled_rule *&,bool &,long long);
+        tm_engine &machine;
+        compiled_rule program[S * ROW];
+        long long hits[S * ROW];
+        std::vector<unsigned char> cells;
+        // tape position of cells[0], and the positions load() copied from the tape
+        long long origin;
+        long long loaded_first;
+        long long loaded_last;
+};
+
+// Every non-halting state and every symbol of a machine's rules and tape must be below
+// states and symbols for it to run as that size
+void neededSize(tm_engine &,int &,int &);
+run_result runSized(tm_engine &,long long);
+
+template <int S, int Y>
+sized_engine<S, Y>::sized_engine(tm_engine &m) : machine(m)
+{
+    origin = 0;
+    loaded_first = loaded_last = 0;
+
+    for (int i = 0; i < S; ++i)
+    {
+        for (int j = 0; j < ROW; ++j)
+        {
+            compiled_rule &c = program[i * ROW + j];
+            if (j == EDGE)
+            {
+                c.next = 0;
+                c.write = 0;
+                c.move = 0;
+                c.halts = GROW;
+                continue;
+            }
+            const transition &rule = machine.getRule(i, j % Y);
+            c.halts = isHaltingState(rule.next_state) ? 1 : 0;
+            c.next = (unsigned char)(c.halts ? (int)rule.next_state : (int)rule.next_state * ROW);
+            c.write = (unsigned char)rule.write_symbol;
+            c.move = rule.move_head == LEFT ? -1 : 1;
+        }
+    }
+}
+
+// Copy the machine's tape into cells: everything written, and everything the head has
+// been above, with SIZEDMARGIN fresh cells and an EDGE beyond that at either end
+template <int S, int Y>
+void sized_engine<S, Y>::load()
+{
+    run_result start = machine.getResult();
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    long long lo = start.tape_min;
+    long long hi = start.tape_max;
+    long long first, last;
+    if (!machine.getTape().findExtent(first, last))
+        first = last = lo;
+    first = std::min(std::min(first, lo), position);
+    last = std::max(std::max(last, hi), position);
+
+    origin = first - SIZEDMARGIN - 1;
+    long long end = last + SIZEDMARGIN + 1;
+    cells.assign((size_t)(end - origin + 1), (unsigned char)(BLANK + Y));
+    cells.front() = EDGE;
+    cells.back() = EDGE;
+
+    loaded_first = first;
+    loaded_last = last;
+    for (long long p = first; p <= last; ++p)
+    {
+        int symbol_int = (int)machine.getTape().getTapeCell(p);
+        cells[(size_t)(p - origin)] = (unsigned char)(p >= lo && p <= hi ? symbol_int : symbol_int + Y);
+    }
+}
+
+// Make the tape longer at the end the head has reached (doubling it), returning where
+// the head is in the new cells
+template <int S, int Y>
+unsigned char *sized_engine<S, Y>::grow(unsigned char *cell)
+{
+    size_t size = cells.size();
+    size_t offset = (size_t)(cell - &cells[0]);
+    bool left = offset == 0;
+
+    std::vector<unsigned char> longer(2 * size, (unsigned char)(BLANK + Y));
+    memcpy(&longer[left ? size : 0], &cells[0], size);
+    longer[left ? size : size - 1] = (unsigned char)(BLANK + Y);
+    longer.front() = EDGE;
+    longer.back() = EDGE;
+    if (left)
+    {
+        origin -= (long long)size;
+        offset += size;
+    }
+    cells.swap(longer);
+    return &cells[offset];
+}
+
+// Copy cells back into the machine's tape (every cell the head has been above, and the
+// ones load() copied), and work out the span from them
+template <int S, int Y>
+void sized_engine<S, Y>::store(unsigned char *cell, bool moved)
+{
+    long long position = origin + (long long)(cell - &cells[0]);
+    size_t lo = 1;
+    size_t hi = cells.size() - 2;
+    while (lo < hi && cells[lo] >= Y)
+        lo++;
+    while (hi > lo && cells[hi] >= Y)
+        hi--;
+
+    long long from = loaded_first;
+    long long to = loaded_last;
+    if (cells[lo] < Y)
+    {
+        from = std::min(from, origin + (long long)lo);
+        to = std::max(to, origin + (long long)hi);
+    }
+
+    tape &t = machine.getTape();
+    // (cells gained and lost by each symbol, for the bytes written straight into pages)
+    long long added[NUMSYM] = {0};
+    for (long long p = from; p <= to; )
+    {
+        if (t.getFormat() == TAPE_BYTES)
+        {
+            // a page at a time, straight into its bytes
+            long long page_start;
+            unsigned char *page = t.getPage(p, page_start);
+            long long stop = std::min(to, page_start + TAPEPAGE - 1);
+            for (; p <= stop; ++p)
+            {
+                unsigned char c = cells[(size_t)(p - origin)];
+                unsigned char &b = page[p - page_start];
+                added[b]--;
+                b = (unsigned char)(c < Y ? c : c - Y);
+                added[b]++;
+            }
+        }
+        else
+        {
+            unsigned char c = cells[(size_t)(p - origin)];
+            t.setTapeCell((symbol)(c < Y ? c : c - Y), p);
+            ++p;
+        }
+    }
+    for (int i = 0; i < NUMSYM; ++i)
+        t.adjustCount((symbol)i, added[i]);
+
+    // (a head that has moved, and stops on a fresh cell, has been above it without
+    // writing)
+    run_result start = machine.getResult();
+    long long span_min = start.tape_min;
+    long long span_max = start.tape_max;
+    if (moved)
+    {
+        span_min = std::min(span_min, position);
+        span_max = std::max(span_max, position);
+    }
+    if (cells[lo] < Y)
+    {
+        span_min = std::min(span_min, origin + (long long)lo);
+        span_max = std::max(span_max, origin + (long long)hi);
+    }
+    machine.setSpan(span_min, span_max);
+    machine.getTapeHead().setTapeHeadLoc(position);
+}
+
+// The step loop: at most max_steps ticks from cell in state current (state * ROW).
+// Returns the number of ticks taken.
+template <int S, int Y>
+inline long long sized_engine<S, Y>::walk(unsigned char *&cell, size_t &current, const compiled_rule *&rule,
+                                          bool &halted, long long max_steps)
+{
+    long long n = 0;
+
+    while (n < max_steps)
+    {
+        rule = &program[current + *cell];
+        hits[current + *cell]++;
+
+        if (rule->halts)
+        {
+            if (rule->halts == GROW)
+            {
+                cell = grow(cell);
+                continue;
+            }
+            // a halting rule doesn't write, move or count as a tick
+            halted = true;
+            break;
+        }
+
+        *cell = rule->write;
+        cell += rule->move;
+        current = rule->next;
+        n++;
+    }
+
+    return n;
+}
+
+// Run the machine for at most max_steps ticks, as tm_engine::run() does. The machine
+// must fit the size (see neededSize()), and mustn't be traced.
+template <int S, int Y>
+run_result sized_engine<S, Y>::run(long long max_steps)
+{
+    if (machine.isHalted() || max_steps <= 0)
+        return machine.getResult();
+
+    load();
+    memset(hits, 0, sizeof(hits));
+
+    unsigned char *cell = &cells[(size_t)(machine.getTapeHead().getTapeHeadLoc() - origin)];
+    size_t current = (size_t)machine.getTapeHead().getCurrentState() * ROW;
+    const compiled_rule *rule = NULL;
+    bool halted = false;
+    long long n = 0;
+
+    // The span only holds the cells the head has moved to, so a head put down outside
+    // it (through tm_engine::getTapeHead()) doesn't count the cell it starts on until
+    // it comes back there: that cell is made fresh again after the first step.
+    if (*cell >= Y)
+    {
+        unsigned char *start = cell;
+        n = walk(cell, current, rule, halted, 1);
+        if (n == 1)
+            *start = (unsigned char)(*start + Y);
+    }
+    if (!halted)
+        n += walk(cell, current, rule, halted, max_steps - n);
+
+    int state_int = (int)(current / ROW);
+    if (halted)
+    {
+        machine.setHalted(true);
+        machine.setHaltRule((state)state_int, (symbol)(*cell % Y));
+    }
+    machine.getTapeHead().setCurrentState(halted ? (state)rule->next : (state)state_int);
+    if (n > 0 && !halted)
+        machine.getTapeHead().setCurrentDirection(rule->move < 0 ? LEFT : RIGHT);
+    machine.setTicks(machine.getTicks() + n);
+    store(cell, n > 0);
+
+    for (int i = 0; i < S; ++i)
+    {
+        for (int j = 0; j < 2 * Y; ++j)
+        {
+            machine.addHits(i, j % Y, hits[i * ROW + j]);
+            if (!program[i * ROW + j].halts)
+                machine.addStateTicks(i, hits[i * ROW + j]);
+        }
+    }
+
+    return machine.getResult();
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static const char trace_magic[8] = {'T','M','T','R','A','C','E','1'};
+
+// Name of one segment file of a trace
+static std::string segmentName(const std::string &base, long long n)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%lld", n);
+    return base + suffix;
+}
+
+//
+// trace writer implementation
+//
+
+trace_writer::trace_writer()
+{
+    ring_size = TRACERING;
+    segment_size = TRACESEGMENT;
+    blocks_per_segment = 0;
+    sequence = 0;
+    header = NULL;
+    block = NULL;
+    failed = false;
+}
+
+trace_writer::~trace_writer()
+{
+    close();
+}
+
+// Start a trace of a machine from its current configuration, in a ring of
+// ring segment files of segment_bytes each. Returns false if the first
+// segment file can't be created.
+bool trace_writer::open(const std::string &base, tm_engine &machine, int ring, long long segment_bytes)
+{
+    close();
+
+    base_name = base;
+    rules = machine.rulesetString(NUMSTT, NUMSYM);
+    ring_size = ring > 0 ? ring : 1;
+    segment_size = segment_bytes;
+    blocks_per_segment = (segment_size - TRACEHEADER) / (long long)sizeof(trace_block);
+    if (blocks_per_segment < 1)
+    {
+        blocks_per_segment = 1;
+        segment_size = TRACEHEADER + (long long)sizeof(trace_block);
+    }
+    sequence = 0;
+    failed = false;
+
+    // segments left over from an earlier trace under the same name would be read as part of this one
+    for (long long n = 0; remove(segmentName(base_name, n).c_str()) == 0; ++n);
+
+    return startSegment(machine.getTicks());
+}
+
+// Finish the trace (everything written so far is already in the files)
+void trace_writer::close()
+{
+    segment.close();
+    header = NULL;
+    block = NULL;
+}
+
+// Whether recording stopped because a segment file couldn't be created (the trace
+// then ends at the last step recorded before that)
+bool trace_writer::hasFailed()
+{
+    return failed;
+}
+
+// Map the next segment file of the ring, overwriting the oldest once the ring is full
+bool trace_writer::startSegment(long long first_tick)
+{
+    header = NULL;
+    block = NULL;
+
+    if (!segment.create(segmentName(base_name, sequence % ring_size), segment_size))
+        return false;
+
+    header = (trace_header *)segment.data();
+    memcpy(header->magic, trace_magic, sizeof(trace_magic));
+    header->sequence = sequence;
+    header->first_tick = first_tick;
+    header->blocks = 0;
+    strncpy(header->rules, rules.c_str(), sizeof(header->rules) - 1);
+    header->rules[sizeof(header->rules) - 1] = '\0';
+
+    sequence++;
+    return true;
+}
+
+// Start a new block (and a new segment when the current one is full), with an index
+// record for the machine's configuration before the step about to be recorded.
+// Returns false (and records nothing more) if the next segment file can't be created.
+bool trace_writer::startBlock(tm_engine &machine)
+{
+    if (failed || header == NULL)
+        return false;
+
+    if (header->blocks == blocks_per_segment && !startSegment(machine.getTicks()))
+    {
+        failed = true;
+        return false;
+    }
+
+    block = (trace_block *)(segment.data() + TRACEHEADER) + header->blocks;
+    header->blocks++;
+
+    long long position = machine.getTapeHead().getTapeHeadLoc();
+    block->tick = machine.getTicks();
+    block->position = position;
+    block->index_state = (unsigned char)machine.getTapeHead().getCurrentState();
+    block->steps = 0;
+
+    tape &t = machine.getTape();
+    long long start = position - TRACEWINDOW / 2;
+    for (int i = 0; i < TRACEWINDOW / 2; ++i)
+        block->window[i] = (unsigned char)(t.getTapeCell(start + 2 * i) | (t.getTapeCell(start + 2 * i + 1) << 4));
+    return true;
+}
+
+//
+// trace reader implementation
+//
+
+trace_reader::trace_reader()
+{
+    tick = position = window_start = 0;
+    current_state = STATE_QA;
+    halted = false;
+    memset(window, 0, sizeof(window));
+}
+
+trace_reader::~trace_reader()
+{
+    close();
+}
+
+void trace_reader::close()
+{
+    for (size_t i = 0; i < segments.size(); ++i)
+        delete segments[i];
+    segments.clear();
+}
+
+// Header and blocks of one segment
+const trace_header *trace_reader::headerOf(size_t s)
+{
+    return (const trace_header *)segments[s]->data();
+}
+
+const trace_block *trace_reader::blockOf(size_t s, long long b)
+{
+    return (const trace_block *)(segments[s]->data() + TRACEHEADER) + b;
+}
+
+// Open the segment files of a trace. Returns false if there are none.
+bool trace_reader::open(const std::string &base)
+{
+    close();
+
+    for (long long n = 0; ; ++n)
+    {
+        mapped_file *file = new mapped_file;
+        if (!file->open(segmentName(base, n)))
+        {
+            delete file;
+            break;
+        }
+
+        const trace_header *h = (const trace_header *)file->data();
+        if (file->size() < TRACEHEADER || memcmp(h->magic, trace_magic, sizeof(trace_magic)) != 0 ||
+            h->blocks < 1 || TRACEHEADER + h->blocks * (long long)sizeof(trace_block) > file->size())
+        {
+            delete file;
+            continue;
+        }
+        segments.push_back(file);
+    }
+
+    // (once the ring has wrapped, the file numbers no longer follow the sequence)
+    for (size_t i = 1; i < segments.size(); ++i)
+        for (size_t j = i; j > 0 && headerOf(j)->sequence < headerOf(j - 1)->sequence; --j)
+            std::swap(segments[j], segments[j - 1]);
+
+    if (segments.empty())
+        return false;
+
+    seek(getFirstTick());
+    return true;
+}
+
+// First and last ticks held by the trace
+long long trace_reader::getFirstTick()
+{
+    return headerOf(0)->first_tick;
+}
+
+long long trace_reader::getLastTick()
+{
+    size_t s = segments.size() - 1;
+    const trace_block *b = blockOf(s, headerOf(s)->blocks - 1);
+    long long steps = b->steps;
+    if (steps > 0 && (b->records[steps - 1] & TRACE_HALTED))
+        steps--;
+    return b->tick + steps;
+}
+
+// The rule-set of the traced machine, in text form
+std::string trace_reader::getRules()
+{
+    const trace_header *h = headerOf(0);
+    return std::string(h->rules, strnlen(h->rules, sizeof(h->rules)));
+}
+
+// Work out the configuration at a tick from the index record of its block and the step
+// records before it. Seeking to the tick the machine halted at gives the halted
+// configuration. Returns false if the tick is outside the trace (the nearest end is used).
+bool trace_reader::seek(long long target)
+{
+    bool inside = target >= getFirstTick() && target <= getLastTick();
+    target = std::max(getFirstTick(), std::min(target, getLastTick()));
+
+    // the last segment starting at or before the tick
+    size_t lo = 0, hi = segments.size();
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (headerOf(mid)->first_tick <= target)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const trace_header *h = headerOf(lo);
+    long long b = std::min((target - h->first_tick) / TRACEINDEX, h->blocks - 1);
+    const trace_block *block = blockOf(lo, b);
+
+    tick = block->tick;
+    position = block->position;
+    current_state = (state)block->index_state;
+    halted = false;
+    window_start = position - TRACEWINDOW / 2;
+    for (int i = 0; i < TRACEWINDOW / 2; ++i)
+    {
+        window[2 * i] = block->window[i] & 15;
+        window[2 * i + 1] = block->window[i] >> 4;
+    }
+
+    for (int i = 0; i < block->steps; ++i)
+    {
+        unsigned short r = block->records[i];
+
+        if (r & TRACE_HALTED)
+        {
+            current_state = (state)(r & TRACE_STATE);
+            halted = true;
+            break;
+        }
+        if (tick == target)
+            break;
+
+        window[position - window_start] = (unsigned char)((r >> TRACE_WRITE_SHIFT) & 7);
+        position += (r & TRACE_RIGHT) ? 1 : -1;
+        current_state = (state)(r & TRACE_STATE);
+        tick++;
+    }
+
+    return inside;
+}
+
+// Put the configuration found by the last seek() into a machine (for display). Only the
+// cells around the tape head are known, the rest of the machine's tape is left blank.
+void trace_reader::load(tm_engine &machine)
+{
+    tape &t = machine.getTape();
+    t.setupTape();
+    for (int i = 0; i < TRACEWINDOW; ++i)
+        if (window[i] != BLANK)
+            t.setTapeCell((symbol)window[i], window_start + i);
+
+    machine.getTapeHead().setTapeHeadLoc(position);
+    machine.getTapeHead().setCurrentState(current_state);
+    machine.setTicks(tick);
+    machine.setHalted(halted);
+}
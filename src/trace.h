@@ -0,0 +1,132 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Binary execution traces. A trace is a ring of segment files (<base>.0, <base>.1 ...)
+// written through memory maps. Each segment is a header followed by fixed size blocks,
+// and each block is an index record (tick, tape head location, state and the tape
+// cells around the tape head) followed by a two byte record for each of the next
+// TRACEINDEX steps (state after the step, symbol read, symbol written and direction).
+// Since every block covers the same number of ticks, a reader finds the block for any
+// tick by arithmetic, and can show the tape around the tape head at that tick from the
+// block alone, without running the machine.
+// Values are stored in the byte order of the machine that wrote the trace.
+
+#include "engine.h"
+#include "mapfile.h"
+#include <string>
+#include <vector>
+
+// Steps recorded per block
+#define TRACEINDEX 256
+// Cells around the tape head kept in each index record (enough to cover the 80
+// column display window wherever the tape head goes during the block)
+#define TRACEWINDOW 640
+// Default segment file size and number of segment files in the ring
+#define TRACESEGMENT (16 << 20)
+#define TRACERING 16
+// Bytes reserved for a segment's header
+#define TRACEHEADER 512
+
+// Layout of a step record
+#define TRACE_STATE  0x001F  // state after the step
+#define TRACE_READ_SHIFT 5   // symbol read (3 bits)
+#define TRACE_WRITE_SHIFT 8  // symbol written (3 bits)
+#define TRACE_RIGHT  0x0800  // the tape head moved right
+#define TRACE_HALTED 0x1000  // a halting transition (nothing written, no move, no tick)
+
+struct trace_header
+{
+    // "TMTRACE1"
+    char magic[8];
+    // position of the segment in the whole trace (the file is <base>.<sequence % ring>)
+    long long sequence;
+    // tick at the start of the segment's first block
+    long long first_tick;
+    // number of blocks written to the segment so far
+    long long blocks;
+    // the machine's rule-set, in text form
+    char rules[NUMSTT * (NUMSYM * 3 + 1)];
+};
+
+struct trace_block
+{
+    // configuration before the block's first step
+    long long tick;
+    long long position;
+    unsigned char index_state;
+    unsigned char unused;
+    // number of step records written to the block so far
+    unsigned short steps;
+    unsigned int reserved;
+    // the cells from position - TRACEWINDOW / 2, two to a byte (low half first)
+    unsigned char window[TRACEWINDOW / 2];
+    unsigned short records[TRACEINDEX];
+};
+
+class trace_writer
+{
+    public:
+        trace_writer();
+        ~trace_writer();
+        bool open(const std::string &,tm_engine &,int,long long);
+        void close();
+        void record(tm_engine &,symbol,const transition &);
+        bool hasFailed();
+    private:
+        bool startBlock(tm_engine &);
+        bool startSegment(long long);
+        std::string base_name;
+        std::string rules;
+        int ring_size;
+        long long segment_size;
+        long long blocks_per_segment;
+        long long sequence;
+        mapped_file segment;
+        trace_header *header;
+        trace_block *block;
+        // a segment file couldn't be created, and recording stopped there
+        bool failed;
+};
+
+// Record one step, from tm_engine::applyTransition() before the step is applied
+inline void trace_writer::record(tm_engine &machine, symbol read, const transition &rule)
+{
+    if ((block == NULL || block->steps == TRACEINDEX) && !startBlock(machine))
+        return;
+
+    unsigned int r = (unsigned int)rule.next_state | ((unsigned int)read << TRACE_READ_SHIFT);
+    if (isHaltingState(rule.next_state))
+        r |= TRACE_HALTED | ((unsigned int)read << TRACE_WRITE_SHIFT);
+    else
+        r |= ((unsigned int)rule.write_symbol << TRACE_WRITE_SHIFT) | (rule.move_head == RIGHT ? TRACE_RIGHT : 0);
+
+    block->records[block->steps++] = (unsigned short)r;
+}
+
+class trace_reader
+{
+    public:
+        trace_reader();
+        ~trace_reader();
+        bool open(const std::string &);
+        void close();
+        long long getFirstTick();
+        long long getLastTick();
+        std::string getRules();
+        bool seek(long long);
+        void load(tm_engine &);
+    private:
+        const trace_header *headerOf(size_t);
+        const trace_block *blockOf(size_t,long long);
+        // segment files, in sequence order
+        std::vector<mapped_file *> segments;
+        // the configuration found by the last seek()
+        long long tick;
+        long long position;
+        state current_state;
+        bool halted;
+        long long window_start;
+        unsigned char window[TRACEWINDOW];
+};
+
+#endif
@@ -1,179 +1,106 @@
 #include "turing.h"
+#include "sized.h"
+#include <math.h>
+#include <stdarg.h>
 
-// print chtype to screen
+// The frame being drawn, and the frame the terminal is showing.
+// Only characters that differ between the two are sent to the terminal, which for a
+// simulation tick is usually just the tape, the rule highlight and the tick count.
+static chtype back_frame[HGT][WID];
+static chtype front_frame[HGT][WID];
+
+// Put a chtype in the frame being drawn.
 // chtype consists of a bitmap containing a char, a color value, and
 // various flags:
 // i.e.
 // ch equaling 'X'|COLOR_PAIR(4)|A_BOLD, x equaling 0 and y equaling 0
-// prints a bright red X at position 0,0 on the terminal window.
+// puts a bright red X at position 0,0 of the window once the frame is shown.
 void addChar(int x, int y, chtype ch)
 {
-    // Note: PDCurses functions take y before x in API calls.
-    // We execute this function in 2 steps.
-
-    // Step 1: Delete character at position 0,0 (this moves each character at position (x,y = 0) to (x-1,y = 0) for
-    // x > 0
-    // Example in 4 rows 10 columns terminal window:
-    // ..........
-    // ..........
-    // ..........
-    // ..........
-
-    // becomes
-
-    // .........
-    // ..........
-    // ..........
-    // ..........
-    // Notice the blank character at the end of the first line
-
-    // Step 2:
-    // Now we insert the X at the original position yielding:
-    // X.........
-    // ..........
-    // ..........
-    // ..........
-    // Reminder: the cursor will be off throughout the entire duration of the program's lifetime.
-    mvdelch(y,x);     // step 1
-    mvinsch(y,x,ch);  // step 2
-}
-
-//
-// tape head class implementation
-//
-
-tape_head::tape_head()
-{
-    // Initialize the location of the tape head to the center of the tape.
-    // This tape doesn't represent the tape in a "theoretical" one-tape Turing Machine
-    // (I believe..., although I might be wrong on this), since the size of the tape is finite
-    loc = TAPESIZE / 2;
-    // initialize the current state of the turing machine tape head to the first enum state
-    curr_state = STATE_QA;
-    // Has no effect on program execution, since during the first iteration of the simulation this value will be overwritten
-    // to a new value based on a rule cell in the transition table.
-    curr_dir = LEFT;
-}
-
-// Move the tape head left or right one unit
-void tape_head::moveTapeHead()
-{
-    if (curr_dir == LEFT)
-        loc--;
-    else
-        loc++;
-
-    // One limitation of this simulation is that the length of the tape is finite.
-    // By default the machine wraps around from one end to another to prevent an out of bounds
-    // access violation.
-    if (loc > TAPESIZE - 1)
-        loc = 0;
-    if (loc < 0)
-        loc = TAPESIZE - 1;
+    if (x >= 0 && x < WID && y >= 0 && y < HGT)
+        back_frame[y][x] = ch;
 }
 
-// Setter for the current state of the tape head
-void tape_head::setCurrentState(state s)
+// printf into the frame being drawn (clipped at the right edge of the window)
+void addText(int x, int y, chtype attributes, const char *format, ...)
 {
-    curr_state = s;
-}
+    char text[WID + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
 
-// Setter for the current direction that the tape head
-// should move at the next iteration.
-void tape_head::setCurrentDirection(direction d)
-{
-    curr_dir = d;
+    for (int i = 0; text[i] != '\0'; ++i)
+        addChar(x + i, y, (chtype)(unsigned char)text[i] | attributes);
 }
 
-// Setter for the tape head location:
-// Manually sets the tape head location.
-void tape_head::setTapeHeadLoc(int l)
+void clearFrame()
 {
-    loc = l;
+    for (int j = 0; j < HGT; ++j)
+        for (int i = 0; i < WID; ++i)
+            back_frame[j][i] = ' ';
 }
 
-// Getter for the tape head location
-int tape_head::getTapeHeadLoc()
+void showFrame()
 {
-    return loc;
-}
-
-// Getter for the current direction
-direction tape_head::getCurrentDirection()
-{
-    return curr_dir;
-}
-
-// Getter for the current state of the tape head
-state tape_head::getCurrentState()
-{
-    return curr_state;
-}
-
-//
-// tape class implementation
-//
-
-tape::tape()
-{
-}
-
-// Initalizes all tape cells to the zeroth
-// enum value for "symbol" (default start values)
-// When simulation is initialized, this method is called.
-// When simulation is reset, this method is called.
-void tape::setupTape()
-{
-    for (int i = 0; i < TAPESIZE; ++i)
+    for (int j = 0; j < HGT; ++j)
     {
-        values[i] = (symbol)0;
+        for (int i = 0; i < WID; ++i)
+        {
+            if (back_frame[j][i] == front_frame[j][i])
+                continue;
+
+            // Note: PDCurses functions take y before x in API calls.
+            if (i == WID - 1 && j == HGT - 1)
+            {
+                // Adding a character to the bottom right corner would move the
+                // cursor off the window, so it is inserted in place instead
+                // (deleting the old one first)
+                mvdelch(j,i);
+                mvinsch(j,i,back_frame[j][i]);
+            }
+            else
+            {
+                mvaddch(j,i,back_frame[j][i]);
+            }
+            front_frame[j][i] = back_frame[j][i];
+        }
     }
-}
 
-// Setter for a tape cell at a given position.
-void tape::setTapeCell(symbol new_val, int position)
-{
-    values[position] = new_val;
+    refresh();
 }
 
-// Getter for a tape cell at a given position
-symbol tape::getTapeCell(int position)
+void invalidateFrame()
 {
-    return values[position];
+    // (no character drawn is ever 0, so every one counts as changed)
+    for (int j = 0; j < HGT; ++j)
+        for (int i = 0; i < WID; ++i)
+            front_frame[j][i] = 0;
 }
 
-
 // primary simulation class
 sim_obj::sim_obj()
 {
-    th_obj = tape_head();
-    tape_obj = tape();
+    machine = tm_engine();
+    running = false;
+    speed = DEFAULTSPEED;
+    heatmap = false;
+    library_name = LIBRARYFILE;
+    num_states = NUMSTT;
+    num_symbols = NUMSYM;
 }
 
 // reset all simulation statistics, rules, tape cells, etc.. and
 // redisplay everything
 void sim_obj::reInitializeEverything(bool rnd)
 {
-    // simulation not running
-    halt = false;
-    // number of ticks for current simulation
-    ticks = 0;
-    // set current tape head state to first (default) state
-    // (only needed when resetting simulation; This is done in tape head
-    // constructor as well)
-    th_obj.setCurrentState(STATE_QA);
-    // set current tape head direction to left (default)
-    // (only needed when resetting simulation; This is done in tape head
-    // constructor as well)
-    th_obj.setCurrentDirection(LEFT);
-    // set machine head to middle of tape
-    // (only needed when resetting simulation; This is done in tape head
-    // constructor as well)
-    th_obj.setTapeHeadLoc(TAPESIZE / 2);
-    // initialize TM rules
-    setupTransitionTable(rnd);
-    // initialize tape
-    tape_obj.setupTape();
+    // initialize TM rules (random ones only use the states and symbols shown)
+    machine.setupTransitionTable(rnd,num_states,num_symbols);
+    // clear the tape, reset the tick count and put the tape head (in its first state)
+    // back in the middle of the tape
+    machine.reset();
+    // the history starts again from the blank tape
+    past.restart(machine);
     // print every component: (ruleset, tape, etc...)
     reDisplay();
 }
@@ -205,10 +132,50 @@ void sim_obj::runApp()
         // Once one of these states is reached the user must reinitialize everything
         // for a new simulation run. Otherwise, if the user presses space, the simulation
         // is paused and may be continued once space is pressed again (here, in the code)
-        if (keyp == ' ' && !halt)
+        if (keyp == ' ' && !machine.isHalted())
         {
             simulate();
         }
+        // undo the last tick
+        if (keyp == 'b')
+        {
+            past.stepBack(machine);
+            reDisplay();
+        }
+        // go back (or forward) to any tick
+        if (keyp == 'g')
+        {
+            long long tick;
+            if (promptNumber("Go to tick: ", tick) && !past.seek(machine, tick))
+                showMessage("[stopped at tick %lld]",machine.getTicks());
+            else
+                reDisplay();
+        }
+        // change the simulation speed
+        if (keyp == '+' || keyp == '=')
+            changeSpeed(1);
+        if (keyp == '-')
+            changeSpeed(-1);
+        // colour the rules by how often they have been used
+        if (keyp == 'h')
+        {
+            heatmap = !heatmap;
+            reDisplay();
+        }
+        // save how often each rule has been used
+        if (keyp == 'x')
+        {
+            saveHits();
+        }
+        // save the rule-set to the library, or load one from it
+        if (keyp == 's')
+        {
+            saveMachine();
+        }
+        if (keyp == 'l')
+        {
+            loadMachine();
+        }
         // reset rules and clear tape
         if (keyp == 'i')
         {
@@ -219,6 +186,11 @@ void sim_obj::runApp()
         {
             reInitializeEverything(true);
         }
+        // change the number of states and symbols the machine has
+        if (keyp == 'z')
+        {
+            changeSize();
+        }
 
         // when the simulation is not running, and the user is changing the tape cells
         // or transition table, the key input can be blocking, waiting for the next user input.
@@ -229,112 +201,204 @@ void sim_obj::runApp()
     } while ((keyp = getch()) != 'q');
 }
 
+// Show a recorded trace instead of running the machine: the display is driven
+// from the trace, tick by tick, without simulating anything.
+void sim_obj::runReplay(trace_reader &trace)
+{
+    // the transition table shows the traced machine's rules
+    machine.parseRuleset(trace.getRules());
+
+    long long tick = trace.getFirstTick();
+    bool playing = false;
+    int keyp = 0;
+
+    do
+    {
+        // space plays or pauses the trace, b and n step back and forward, g goes to a tick
+        if (keyp == ' ')
+            playing = !playing;
+        if (keyp == 'b')
+            tick--;
+        if (keyp == 'n' || (playing && keyp == ERR))
+            tick++;
+        if (keyp == 'g')
+        {
+            long long target;
+            if (promptNumber("Go to tick: ", target))
+                tick = target;
+        }
+
+        tick = std::max(trace.getFirstTick(), std::min(tick, trace.getLastTick()));
+        if (tick == trace.getLastTick())
+            playing = false;
+
+        trace.seek(tick);
+        trace.load(machine);
+        reDisplay();
+
+        // the same 50 milliseconds a tick as a live simulation
+        timeout(playing ? 50 : -1);
+
+    } while ((keyp = getch()) != 'q');
+}
+
 // Run the simulation given the tape cells up until this point and the transition table (ruleset).
+// The machine runs on its own thread (see sim_runner), at the chosen speed or as fast as
+// it can, while this thread draws it FRAMERATE times a second. Mouse edits are passed on
+// to the running machine. Space pauses the simulation; it also stops when a halting state
+// (Reject, Accept or Halt) is reached, and the user then has to reset for a new run.
 void sim_obj::simulate()
 {
-    // unblock key input for simulation so that is runs continuously (with tick delay)
-    timeout(0);
+    runner.start(machine, past, speeds[speed]);
+    running = true;
+
+    // unblock key input so that frames keep being drawn while no key is pressed
+    timeout(1000 / FRAMERATE);
+
+    MEVENT minput = {0,0,0,0,0};
+    int keyp = ERR;
+    sim_snapshot view;
 
     do
     {
-        // See 2 points below
-        applyTransition();
-
-        // redisplay only the TM tape and tape head
-        reDisplayMachine();
-
-        // 50 milliseconds is the time for each simulation tick
-        // one tick consists of:
-        // 1) changing the tape head state to the appropriate state based on its state and the tape's
-        //    cell beneath it
-        // 2) changing the tape's cell based on the initial tape state and the cell beneath it.
-        napms(50);
-        // needed after napms call according to PDCurses documentation
-        refresh();
-
-        // if a halting state has been reached (Reject,Accept,or Halt setting this flag to true)
-        // break out of the simulation and force the user to reset. This current run has permanently
-        // ended...
-        if (halt)
+        if (keyp == KEY_MOUSE)
+            checkClick(minput);
+        if (keyp == '+' || keyp == '=')
+            changeSpeed(1);
+        if (keyp == '-')
+            changeSpeed(-1);
+        if (keyp == 'h')
+            heatmap = !heatmap;
+
+        runner.getSnapshot(view);
+        showSnapshot(view);
+
+        if (view.halted || !runner.isRunning())
             break;
 
-        // Move the tape head left or right depending on the ruleset and current states
-        th_obj.moveTapeHead();
+      // Loop until simulation is paused
+    } while ((keyp = getch()) != ' ');
 
-        // reDisplay to update the transition
-        reDisplay();
+    // the machine (with all its tape) is handed back by the runner
+    runner.stop(machine);
+    running = false;
+    reDisplay();
+}
 
-        // This entire loop consists of one simulation tick
-        ticks++;
+// Draw the running machine from a snapshot. Only the cells around the tape head
+// are copied into machine, which is all the display shows (the counts shown in the
+// stats are the whole tape's).
+void sim_obj::showSnapshot(const sim_snapshot &view)
+{
+    tape &t = machine.getTape();
+    t.setupTape();
+    for (int i = 0; i < RUNNERVIEW; ++i)
+        if (view.view[i] != BLANK)
+            t.setTapeCell(view.view[i], view.position - RUNNERVIEW / 2 + i);
 
-        // Delay for one millisecond (I think this is for display
-        // synchronization purposes, but I can't remember exactly why I put it in.
-        napms(1);
-        refresh();
+    machine.getTapeHead().setTapeHeadLoc(view.position);
+    machine.getTapeHead().setCurrentState(view.current_state);
+    machine.setTicks(view.ticks);
+    machine.setHalted(view.halted);
+    for (int i = 0; i < NUMSTT; ++i)
+        for (int j = 0; j < NUMSYM; ++j)
+            machine.addHits(i, j, view.hits[i * NUMSYM + j] - machine.getHits(i, j));
+    for (int i = 0; i < NUMSTT; ++i)
+        machine.addStateTicks(i, view.state_ticks[i] - machine.getStateTicks(i));
+    // (and the stats of the whole tape, not just the cells copied)
+    for (int i = 0; i < NUMSYM; ++i)
+        if (i != BLANK)
+            t.adjustCount((symbol)i, view.symbols[i] - t.countSymbol((symbol)i));
+    machine.setSpan(view.tape_min, view.tape_max);
 
-      // Loop until simulation is paused
-    } while (getch() != ' ');
+    reDisplay();
 }
 
-// apply one step of the transition table rule-set onto the TM
-void sim_obj::applyTransition()
+// Go up or down the list of speeds
+void sim_obj::changeSpeed(int change)
 {
-    // What is the index of the tape cell that the tape head is currently located at?
-    int tape_head_loc = th_obj.getTapeHeadLoc();
+    speed = std::max(0, std::min(speed + change, NUMSPEEDS - 1));
+
+    if (running)
+    {
+        sim_command c = sim_command();
+        c.kind = COMMAND_RATE;
+        c.position = speeds[speed];
+        runner.post(c);
+    }
+    else
+    {
+        printStats();
+        showFrame();
+    }
+}
 
-    // What is the current symbol of the tape cell above the tape head?
-    symbol current_symbol = tape_obj.getTapeCell(tape_head_loc);
+// Edits from the mouse: made to the running machine through the runner if the
+// simulation is running, otherwise straight to the machine (starting its history again)
+void sim_obj::editRule(int state_int, int symbol_int, const transition &rule)
+{
+    // (the display's copy has the rule as well, so the table shows it)
+    machine.setRule(state_int,symbol_int,rule);
 
-    // What is the current state of the tape head?
-    state current_state = th_obj.getCurrentState();
+    if (running)
+    {
+        sim_command c = sim_command();
+        c.kind = COMMAND_RULE;
+        c.row = state_int;
+        c.col = symbol_int;
+        c.rule = rule;
+        runner.post(c);
+    }
+    else
+    {
+        past.restart(machine);
+    }
+}
 
-    // Set the current state of the tape head based on current_symbol and current_state
-    th_obj.setCurrentState(ruleset[(int)current_state][(int)current_symbol].next_state);
+void sim_obj::editCell(long long position, symbol sym)
+{
+    machine.getTape().setTapeCell(sym,position);
 
-    // The tape head is in a non-halting state...
-    if (th_obj.getCurrentState() != STATE_QACCEPT && th_obj.getCurrentState() != STATE_QREJECT && th_obj.getCurrentState() != STATE_QHALT)
+    if (running)
     {
-        // then set the tape head's next direction
-        th_obj.setCurrentDirection(ruleset[(int)current_state][(int)current_symbol].move_head);
-        // and set the tape cell's next symbol value
-        tape_obj.setTapeCell(ruleset[(int)current_state][(int)current_symbol].write_symbol,tape_head_loc);
+        sim_command c = sim_command();
+        c.kind = COMMAND_CELL;
+        c.position = position;
+        c.sym = sym;
+        runner.post(c);
     }
     else
     {
-        // otherwise the current simulation run should come to an end (as signified by this flag)
-        halt = true;
+        past.restart(machine);
     }
 }
 
-// initialize the rule-set
-// To start all combinations of states and symbols should yield:
-// goto state a, print symbol . on tape, move left
-void sim_obj::setupTransitionTable(bool rnd)
+void sim_obj::moveHead(long long position)
 {
-    for (int i = 0; i < NUMSTT; ++i)
+    machine.getTapeHead().setTapeHeadLoc(position);
+
+    if (running)
     {
-        for (int j = 0; j < NUMSYM; ++j)
-        {
-            // if i == 3 and j == 5, for instance, then
-            // state "c" and symbol "1" on the transition table should produce
-            // a/./left (as should every other combination to start out)
-            ruleset[i][j].curr_state = (state)i;
-            ruleset[i][j].curr_symbol = (symbol)j;
-            ruleset[i][j].next_state = (rnd == false ? (state)0 : (state)(rand() % (NUMSTT + 3)));
-            ruleset[i][j].write_symbol = (rnd == false ? (symbol)0 : (symbol)(rand() % NUMSYM));
-            ruleset[i][j].move_head = (rnd == false ? (direction)0 : (direction)(rand() % 2));
-        }
+        sim_command c = sim_command();
+        c.kind = COMMAND_HEAD;
+        c.position = position;
+        runner.post(c);
+    }
+    else
+    {
+        past.restart(machine);
     }
 }
 
 // Draw everything: the machine, rule-set and stats parts of the window.
 void sim_obj::reDisplay()
 {
-    clear();
+    clearFrame();
     printTape();
     printTapeHead();
     printTransitionTable();
     printStats();
+    showFrame();
 }
 
 void sim_obj::reDisplayMachine()
@@ -357,6 +421,7 @@ void sim_obj::reDisplayMachine()
     // Once clear, print the state of the new tape and tape head
     printTape();
     printTapeHead();
+    showFrame();
 }
 
 // Check to see if the user clicked on the rule-set table.
@@ -366,10 +431,12 @@ void sim_obj::checkTransitionTableClick(int x, int y)
      int state_int = 0;
      // Outermost array index value for ruleset
      int symbol_int = 0;
+     // The rule being changed (the machine re-derives its compiled rule-set on every change)
+     transition rule;
 
      // The transition table occurs on values 10,12,14,16,18 and 20 along the y axis:
      // Check if the y cursor is within these bounds
-     if (y % 2 == 0 && y >= 10 && y <= 20)
+     if (y % 2 == 0 && y >= 10 && y < 10 + 2 * num_symbols && x < 5 * num_states)
      {
          // The symbol index is either 0,1,2,3,4 or 5 corresponding to one of the
          // (BLANK, CROSS, ASTERISK, AMPERSAND, ZERO, ONE) enumeration values
@@ -380,7 +447,9 @@ void sim_obj::checkTransitionTableClick(int x, int y)
          {
              // Increment this rule's next state
              state_int = (int)((x - 2) / 5);
-             ruleset[state_int][symbol_int].next_state = getNextRuleState(state_int,symbol_int);
+             rule = machine.getRule(state_int,symbol_int);
+             rule.next_state = getNextRuleState(state_int,symbol_int);
+             editRule(state_int,symbol_int,rule);
          }
 
          // The user clicked on a symbol character in the rule-set table
@@ -388,7 +457,9 @@ void sim_obj::checkTransitionTableClick(int x, int y)
          {
              // Increment this rule's next symbol
              state_int = (int)((x - 3) / 5);
-             ruleset[state_int][symbol_int].write_symbol = getNextRuleSymbol(state_int,symbol_int);
+             rule = machine.getRule(state_int,symbol_int);
+             rule.write_symbol = getNextRuleSymbol(state_int,symbol_int);
+             editRule(state_int,symbol_int,rule);
          }
 
          // The user clicked on a direction character ('l' or 'r') in the rule-set table
@@ -396,7 +467,9 @@ void sim_obj::checkTransitionTableClick(int x, int y)
          {
              // Increment this rule's next direction
              state_int = (int)((x - 4) / 5);
-             ruleset[state_int][symbol_int].move_head = getNextRuleDirection(state_int,symbol_int);
+             rule = machine.getRule(state_int,symbol_int);
+             rule.move_head = getNextRuleDirection(state_int,symbol_int);
+             editRule(state_int,symbol_int,rule);
          }
 
          // Redraw the rule-set table to reflect the latest change
@@ -407,48 +480,41 @@ void sim_obj::checkTransitionTableClick(int x, int y)
 // Check to see if the user clicked on the TM tape.
 void sim_obj::checkTapeCellAreaClick(int x, int y)
 {
-     // Index of the tape array
-     int curr_symbol_int = 0;
+     // Index of the tape cell
+     long long curr_symbol_int = 0;
 
      // The y value of the tape on the window.
      if (y == 3)
      {
          // Offset symbol based on positioning of the TM tape head with respect to the window
-         curr_symbol_int = x + th_obj.getTapeHeadLoc() - (WID / 2);
-         // Make sure the user didn't click off the edge of the tape (otherwise segfault)
-         if (curr_symbol_int >= 0 && curr_symbol_int <= TAPESIZE - 1)
-         {
-             // Increment the enum value of that tape cell manually
-             tape_obj.setTapeCell((symbol)(((int)tape_obj.getTapeCell(curr_symbol_int) + 1) % NUMSYM),curr_symbol_int);
-             // Redraw rule-set to reflect latest change (We need to call this since the current transition may have been
-             // been changed to reflect the latest modification to the tape)
-             printTransitionTable();
-             // And then redraw tape to reflect latest change
-             printTape();
-             printTapeHead();
-         }
+         // (the tape is unbounded, so every click lands on a cell)
+         curr_symbol_int = x + machine.getTapeHead().getTapeHeadLoc() - (WID / 2);
+         // Increment the enum value of that tape cell manually
+         editCell(curr_symbol_int,(symbol)(((int)machine.getTape().getTapeCell(curr_symbol_int) + 1) % num_symbols));
+         // Redraw rule-set to reflect latest change (We need to call this since the current transition may have been
+         // been changed to reflect the latest modification to the tape)
+         printTransitionTable();
+         // And then redraw tape to reflect latest change
+         printTape();
+         printTapeHead();
      }
 }
 
 // Check to see if the user clicked on the same x-axis of the tape head on the window.
 void sim_obj::checkTapeHeadAreaClick(int x, int y)
 {
-     // Index of the tape array
-     int curr_symbol_int = 0;
+     // Index of the tape cell
+     long long curr_symbol_int = 0;
 
      // Only the top 2 window tiles make up the area that the tape head can move.
      if (y == 0 || y == 1)
      {
          // Offset symbol based on positioning of the TM tape head with respect to the window
-         curr_symbol_int = x + th_obj.getTapeHeadLoc() - (WID / 2);
-         // Make sure the user didn't click off the edge of the tape (otherwise segfault)
-         if (curr_symbol_int >= 0 && curr_symbol_int <= TAPESIZE - 1)
-         {
-            // Set the tape head x location along TM to be where the user's relative click position.
-            th_obj.setTapeHeadLoc(curr_symbol_int);
-            // Redraw everything
-            reDisplay();
-         }
+         curr_symbol_int = x + machine.getTapeHead().getTapeHeadLoc() - (WID / 2);
+         // Set the tape head x location along TM to be where the user's relative click position.
+         moveHead(curr_symbol_int);
+         // Redraw everything
+         reDisplay();
      }
 }
 
@@ -469,83 +535,280 @@ void sim_obj::checkClick(MEVENT minput)
      checkTapeCellAreaClick(x,y);
      // Area above the TM tape was clicked
      checkTapeHeadAreaClick(x,y);
+
+     // Show whatever was redrawn
+     showFrame();
+}
+
+// Ask for a number on the bottom line of the window.
+// Returns false if nothing that starts with a number was typed.
+bool sim_obj::promptNumber(const char *prompt, long long &value)
+{
+    char text[32] = "";
+
+    move(HGT - 1, 0);
+    clrtoeol();
+    mvprintw(HGT - 1, 0, "%s", prompt);
+
+    // show what is typed while it is being typed
+    timeout(-1);
+    echo();
+    curs_set(1);
+    getnstr(text, sizeof(text) - 1);
+    noecho();
+    curs_set(0);
+    // the prompt was drawn straight on the window
+    invalidateFrame();
+
+    char *end;
+    value = strtoll(text, &end, 10);
+    return end != text;
 }
 
 // Get the next rule direction (which can only be one of 2 values) of rule <state = state_int symbol = symbol_int>
 direction sim_obj::getNextRuleDirection(int state_int, int symbol_int)
 {
    // The 2 values are 'l' and 'r'
-   return (direction)(((int)ruleset[state_int][symbol_int].move_head + 1) % 2);
+   return (direction)(((int)machine.getRule(state_int,symbol_int).move_head + 1) % 2);
 }
 
 // Get the next rule symbol of rule <state = state_int symbol = symbol_int>
 symbol sim_obj::getNextRuleSymbol(int state_int, int symbol_int)
 {
-   // There are NUMSYM (6) possible values
-   return (symbol)(((int)ruleset[state_int][symbol_int].write_symbol + 1) % NUMSYM);
+   // There are num_symbols (up to NUMSYM, 6) possible values
+   return (symbol)(((int)machine.getRule(state_int,symbol_int).write_symbol + 1) % num_symbols);
 }
 
 // Get the next rule state of rule <state = state_int symbol = symbol_int>
 state sim_obj::getNextRuleState(int state_int, int symbol_int)
 {
-   // NUMSTT corresponds to non-halting states (16) (+ 3 added to include the 3 halting states)
-   return (state)(((int)ruleset[state_int][symbol_int].next_state + 1) % (NUMSTT + 3));
+   // num_states non-halting states (up to NUMSTT, 16) are followed by the 3 halting states
+   int next = (int)machine.getRule(state_int,symbol_int).next_state;
+   next = (isHaltingState((state)next) ? num_states + next - NUMSTT : next) + 1;
+   next %= num_states + 3;
+   return (state)(next < num_states ? next : NUMSTT + next - num_states);
+}
+
+// Colour for a rule in the heatmap: the rules never used are dark, the others go from
+// blue through cyan, green and yellow to red by the log of how often they were used
+// compared to the most used rule.
+static chtype heatColour(long long hits, long long most)
+{
+    static const chtype scale[5] =
+    {
+        COLOR_PAIR(1)|A_BOLD, COLOR_PAIR(3)|A_BOLD, COLOR_PAIR(2)|A_BOLD,
+        COLOR_PAIR(6)|A_BOLD, COLOR_PAIR(4)|A_BOLD
+    };
+
+    if (hits <= 0)
+        return COLOR_PAIR(8)|A_BOLD;
+    if (most <= 1)
+        return scale[4];
+
+    int level = (int)(log((double)hits) / log((double)most) * 4.0 + 0.5);
+    return scale[std::max(0, std::min(level, 4))];
+}
+
+// A character of the table drawn in a heatmap colour (or as it is, outside the heatmap)
+static chtype heatChar(chtype ch, chtype heat)
+{
+    if (heat == 0)
+        return ch;
+    return (ch & A_CHARTEXT) | heat;
+}
+
+// Write how often each rule has been used to HITSFILE (as CSV)
+void sim_obj::saveHits()
+{
+    FILE *out = fopen(HITSFILE, "w");
+    if (out != NULL)
+    {
+        std::string text = machine.hitsCSV(NUMSTT, NUMSYM);
+        fwrite(text.data(), 1, text.size(), out);
+        fclose(out);
+    }
+
+    showMessage(out != NULL ? "[saved to %s]" : "[can't write %s]",HITSFILE);
+}
+
+// Use another machine library than LIBRARYFILE
+void sim_obj::setLibrary(const std::string &name)
+{
+    library_name = name;
+}
+
+// Add the rule-set to the end of the library
+void sim_obj::saveMachine()
+{
+    library_writer library;
+    long long index = library.open(library_name) ? library.add(machine) : -1;
+    if (!library.close())
+        index = -1;
+
+    if (index >= 0)
+        showMessage("[saved as machine %lld]",index);
+    else
+        showMessage("[can't write %s]",library_name.c_str());
+}
+
+// Ask for a machine of the library and start it from a blank tape
+void sim_obj::loadMachine()
+{
+    long long index;
+    if (!promptNumber("Library machine: ", index))
+    {
+        reDisplay();
+        return;
+    }
+
+    machine_library library;
+    if (!library.open(library_name))
+    {
+        showMessage("[no library %s]",library_name.c_str());
+        return;
+    }
+    if (!library.load(index, machine))
+    {
+        showMessage("[no machine %lld of %lld]",index,library.getCount());
+        return;
+    }
+
+    // show as many states and symbols as the machine uses
+    machine.reset();
+    neededSize(machine, num_states, num_symbols);
+    num_symbols = std::max(num_symbols, 2);
+    past.restart(machine);
+    showMessage("[machine %lld of %lld]",index,library.getCount());
+}
+
+// Ask for the number of states and symbols the machine has. The transition table only
+// shows those, random rule-sets only use them, and the rules outside them are set back
+// to a/./left.
+void sim_obj::changeSize()
+{
+    long long states, symbols;
+    if (!promptNumber("Non-halting states (1-16): ", states) || !promptNumber("Symbols (2-6): ", symbols))
+    {
+        reDisplay();
+        return;
+    }
+
+    num_states = (int)std::max(1LL, std::min(states, (long long)NUMSTT));
+    num_symbols = (int)std::max(2LL, std::min(symbols, (long long)NUMSYM));
+
+    transition rule;
+    for (int i = 0; i < NUMSTT; ++i)
+    {
+        for (int j = 0; j < NUMSYM; ++j)
+        {
+            rule = machine.getRule(i,j);
+            bool outside = !isHaltingState(rule.next_state) && (int)rule.next_state >= num_states;
+            if (i < num_states && j < num_symbols && !outside && (int)rule.write_symbol < num_symbols)
+                continue;
+            if (rule.next_state == STATE_QA && rule.write_symbol == BLANK && rule.move_head == LEFT)
+                continue;
+            rule.next_state = STATE_QA;
+            rule.write_symbol = BLANK;
+            rule.move_head = LEFT;
+            editRule(i,j,rule);
+        }
+    }
+
+    reDisplay();
+}
+
+// Show a message on the border in place of the key label, until the next redraw
+void sim_obj::showMessage(const char *format, ...)
+{
+    char text[WID + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    reDisplay();
+    for (int i = 1; i < 31; ++i)
+        addChar(i,HGT-3,'=');
+    addText(1,HGT-3,COLOR_PAIR(7)|A_BOLD,"%s",text);
+    showFrame();
 }
 
 // Redraw the transition table
 void sim_obj::printTransitionTable()
 {
     // Current tape cell the tape head is above
-    symbol current_symbol = tape_obj.getTapeCell(th_obj.getTapeHeadLoc());
+    symbol current_symbol = machine.getTape().getTapeCell(machine.getTapeHead().getTapeHeadLoc());
     // Current state of the tape head
-    state current_state = th_obj.getCurrentState();
+    state current_state = machine.getTapeHead().getCurrentState();
     // Highlight the current rule on the rule-set
     chtype highlight;
+    // In the heatmap, the colour every character of a rule is drawn in
+    chtype heat = 0;
+
+    // The most used rule and the total number of ticks, for the heatmap
+    long long most_hits = 0;
+    long long total_ticks = 0;
+    if (heatmap)
+    {
+        for (int i = 0; i < NUMSTT; ++i)
+        {
+            for (int j = 0; j < NUMSYM; ++j)
+                most_hits = std::max(most_hits, machine.getHits(i,j));
+            total_ticks += machine.getStateTicks(i);
+        }
+    }
 
     // Location of character to be drawn
     int charx = 0;
     int chary = 0;
 
     // Draw the symbol legend
-    for (int i = 0; i < NUMSYM; ++i)
+    for (int i = 0; i < num_symbols; ++i)
     {
         chary = 10+(i*2);
         addChar(0,chary,symbol_ch[i]);
     }
 
     // Draw the state legend
-    for (int i = 0; i < NUMSTT; ++i)
+    for (int i = 0; i < num_states; ++i)
     {
         charx = 3+(i*5);
         addChar(charx,8,state_ch[i]);
+
+        // and above it, in the heatmap, the percentage of ticks spent in the state
+        if (heatmap && total_ticks > 0)
+            addText(charx-1,6,COLOR_PAIR(7),"%3d",(int)(machine.getStateTicks(i) * 100 / total_ticks));
     }
 
     // Draw each possible rule
-    for (int i = 0; i < NUMSTT; ++i)
+    for (int i = 0; i < num_states; ++i)
     {
-        for (int j = 0; j < NUMSYM; ++j)
+        for (int j = 0; j < num_symbols; ++j)
         {
             // Note, on PDCurses A_BLINK will just highlight, which is the intended effect
             // On 'nix system terminals the highlighted region might blink (haven't tested)
-            if (current_state == ruleset[i][j].curr_state &&
-                current_symbol == ruleset[i][j].curr_symbol)
+            if (current_state == machine.getRule(i,j).curr_state &&
+                current_symbol == machine.getRule(i,j).curr_symbol)
                 highlight = A_BLINK;
             else
                 highlight = 0;
 
+            if (heatmap)
+                heat = heatColour(machine.getHits(i,j), most_hits);
+
             charx = 3+(i*5);
             chary = 10+(j*2);
 
             // Add state character (highlighted if current transition is in this rule) corresponding to the
             // next state at this rule.
-            addChar(charx-1,chary,state_ch[(int)ruleset[i][j].next_state]|highlight);
+            addChar(charx-1,chary,heatChar(state_ch[(int)machine.getRule(i,j).next_state],heat)|highlight);
 
-            if ((int)ruleset[i][j].next_state < 16)
+            if ((int)machine.getRule(i,j).next_state < 16)
             {
                 // Do the same for symbol
-                addChar(charx,chary,symbol_ch[(int)ruleset[i][j].write_symbol]|highlight);
+                addChar(charx,chary,heatChar(symbol_ch[(int)machine.getRule(i,j).write_symbol],heat)|highlight);
                 // Do the same for the direction
-                addChar(charx+1,chary,dir_ch[(int)ruleset[i][j].move_head]|highlight);
+                addChar(charx+1,chary,heatChar(dir_ch[(int)machine.getRule(i,j).move_head],heat)|highlight);
             }
             else
             {
@@ -562,14 +825,31 @@ void sim_obj::printTransitionTable()
 void sim_obj::printStats()
 {
     // Print information about how to use program and simulation metrics
-    mvprintw(HGT - 2,0,"Num non-halting states: %d", NUMSTT);
-    mvprintw(HGT - 1,0,"Tape alphabet =      ");
-    mvprintw(HGT - 2,28,"SPACE-pause/run i-reset q-quit");
-    mvprintw(HGT - 1,28,"LCLICK-alter rule,cell/move head");
-    mvprintw(HGT - 2,62,"Ticks -> %d",ticks);
+    addText(0,HGT - 2,A_NORMAL,"States: %-2d (z-size)", num_states);
+    addText(0,HGT - 1,A_NORMAL,"Tape alphabet =      ");
+    addText(28,HGT - 2,A_NORMAL,"SPACE-pause/run i-reset q-quit");
+    addText(28,HGT - 1,A_NORMAL,"LCLICK-alter rule,cell/move head");
+    addText(62,HGT - 2,A_NORMAL,"Ticks -> %lld",machine.getTicks());
+    addText(62,HGT - 1,A_NORMAL,"b-back g-goto");
+
+    // Tape statistics (kept up to date as the tape is written, so nothing is scanned)
+    // on the line below the tape
+    run_result now = machine.getResult();
+    char tape_stats[WID + 1];
+    int len = snprintf(tape_stats, sizeof(tape_stats), "Written %lld:", now.non_blank);
+    for (int i = 0; i < NUMSYM && len < WID; ++i)
+    {
+        long long count = machine.getTape().countSymbol((symbol)i);
+        if (i != BLANK && count > 0)
+            len += snprintf(tape_stats + len, sizeof(tape_stats) - len, " %c %lld", symbol_char[i], count);
+    }
+    if (len < WID)
+        snprintf(tape_stats + len, sizeof(tape_stats) - len, "  Span %lld..%lld  Excursion %lld",
+                 now.tape_min, now.tape_max, std::max(-now.tape_min, now.tape_max));
+    addText(0,5,COLOR_PAIR(8)|A_DIM,"%-*s",WID - 1,tape_stats);
 
     // Print at x positions 18, 20, 22, 24, 26 entire tape alphabet
-    for (int i = 0; i < NUMSYM; ++i)
+    for (int i = 0; i < num_symbols; ++i)
     {
         addChar(16+i,HGT - 1,symbol_ch[i]);
     }
@@ -581,9 +861,19 @@ void sim_obj::printStats()
     }
 
     // Print label for this section of the window
-    attron(COLOR_PAIR(8)|A_DIM|A_BLINK);
-    mvprintw(HGT-3,WID/2 - 8,"Simulation Info");
-    attroff(COLOR_PAIR(8)|A_DIM|A_BLINK);
+    addText(WID/2 - 8,HGT-3,COLOR_PAIR(8)|A_DIM|A_BLINK,"Simulation Info");
+
+    // and the simulation speed on the right of the border
+    char speed_label[32];
+    int speed_len;
+    if (speeds[speed] == 0)
+        speed_len = snprintf(speed_label, sizeof(speed_label), "[+/- full speed]");
+    else
+        speed_len = snprintf(speed_label, sizeof(speed_label), "[+/- %lld ticks/s]", speeds[speed]);
+    addText(WID - 1 - speed_len,HGT-3,COLOR_PAIR(8)|A_DIM,"%s",speed_label);
+
+    // and the rule usage and library keys on the left
+    addText(1,HGT-3,COLOR_PAIR(8)|A_DIM,"[h-heat x-hits s-save l-load]");
 }
 
 // output tape head (a '#' symbol and a symbol that denotes the state (enum))
@@ -591,47 +881,31 @@ void sim_obj::printTapeHead()
 {
     addChar(40, 2,  '|' | COLOR_PAIR(8) | A_BOLD);
     addChar(40, 1,  '#' | COLOR_PAIR(6) | A_BOLD);
-    addChar(40, 0, state_ch[(int)th_obj.getCurrentState()]);
+    addChar(40, 0, state_ch[(int)machine.getTapeHead().getCurrentState()]);
 }
 
 // print tape to console screen
 void sim_obj::printTape()
 {
-    int tape_head_loc = th_obj.getTapeHeadLoc();
+    long long tape_head_loc = machine.getTapeHead().getTapeHeadLoc();
 
     // Tape head is always visible on the x-axis center (of window).
     // That is, the tape moves with respect to the window leaving the tape head
     // to appear stationary relative to the window.
-    int x_min = tape_head_loc - (WID / 2);
+    long long x_min = tape_head_loc - (WID / 2);
 
     for (int i = 0; i < WID; ++i)
     {
-        // print "----" aesthetic borders to signify where the visible tape begins and ends
+        // print "----" aesthetic borders above and below the visible tape
         // (its really just one character tall)
-        // Only do this if the end of the tape is out of range of the window, otherwise print blank chtype
-        // values.
-        // For instance, for a window of width 15:
+        // The tape never ends, so for a window of width 15:
         // ---------------
         // .......H.......
         // ---------------
-        // is printed if ends beyond window for both ends of the tape
-        // or something like (although mathematically skewed probably by about a tile)...
-        //      ----------
-        //      ..H.......
-        //      ----------
-        // if left end is near head (and vice versa for right end)
-        if (x_min + i >= 0 && x_min + i <= TAPESIZE - 1)
-        {
-            addChar(i, 2, '-'|COLOR_PAIR(7)|A_BOLD);
-            addChar(i, 4, '-'|COLOR_PAIR(7)|A_BOLD);
-            addChar(i, 3, symbol_ch[(int)tape_obj.getTapeCell(x_min + i)]);
-        }
-        else
-        {
-            addChar(i, 2, ' ');
-            addChar(i, 4, ' ');
-            addChar(i, 3, ' ');
-        }
+        // is always printed.
+        addChar(i, 2, '-'|COLOR_PAIR(7)|A_BOLD);
+        addChar(i, 4, '-'|COLOR_PAIR(7)|A_BOLD);
+        addChar(i, 3, symbol_ch[(int)machine.getTape().getTapeCell(x_min + i)]);
     }
 
     // print left center and right coordinates of tape with respect to tape window.
@@ -640,9 +914,10 @@ void sim_obj::printTape()
     // ........H.......
     // (-8)---(0)---(7)
     // See notes about A_BLINK in documentation if you want to port to ncurses (I haven't tested any of this on Linux)
-    attron(COLOR_PAIR(8)|A_DIM|A_BLINK);
-    mvprintw(4,abs(std::min(0,x_min)),"%d",std::max(x_min,0)-(TAPESIZE/2));
-    mvprintw(4,std::min(WID - 4,TAPESIZE - x_min - 5),"%d",std::min(x_min + WID - 1,TAPESIZE - 1)-(TAPESIZE/2));
-    mvprintw(4,40,"%d",tape_head_loc-(TAPESIZE/2));
-    attroff(COLOR_PAIR(8)|A_DIM|A_BLINK);
+    char right_label[32];
+    int right_len = snprintf(right_label, sizeof(right_label), "%lld", x_min + WID - 1);
+
+    addText(0,4,COLOR_PAIR(8)|A_DIM|A_BLINK,"%lld",x_min);
+    addText(WID - right_len,4,COLOR_PAIR(8)|A_DIM|A_BLINK,"%s",right_label);
+    addText(40,4,COLOR_PAIR(8)|A_DIM|A_BLINK,"%lld",tape_head_loc);
 }
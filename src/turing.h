@@ -1,41 +1,31 @@
 #include "curses.h"
+#include "engine.h"
+#include "history.h"
+#include "trace.h"
+#include "runner.h"
+#include "library.h"
 #include <stdlib.h>
 #include <time.h>
 #include <iostream>
+#include <algorithm>
 
 // window width and height
 static const int HGT = 24;
 static const int WID = 80;
 
-// fixed TM tape size
-#define TAPESIZE 1024
+// Frames drawn per second while the simulation is running
+#define FRAMERATE 30
 
-// There are 6*16 possible rules
-#define NUMSYM 6
-#define NUMSTT 16 // num non halting states
+// Simulation speeds (ticks per second, 0 for as fast as possible) that + and - step
+// through, and the one to start at (the original 50 millisecond tick)
+static const long long speeds[] = {1, 5, 20, 100, 1000, 10000, 100000, 1000000, 0};
+#define NUMSPEEDS ((int)(sizeof(speeds) / sizeof(speeds[0])))
+#define DEFAULTSPEED 2
 
-// Direction the TM tape head will go
-enum direction
-{
-	LEFT,RIGHT
-};
-
-// A TM tape symbol
-enum symbol
-{
-	BLANK, CROSS, ASTERISK, AMPERSAND, ZERO, ONE
-};
-
-// A TM tape state (3 are halting states)
-enum state
-{
-	STATE_QA, STATE_QB, STATE_QC, STATE_QD,
-	STATE_QE, STATE_QF, STATE_QG, STATE_QH,
-	STATE_QI, STATE_QJ, STATE_QK, STATE_QL,
-	STATE_QM, STATE_QN, STATE_QO, STATE_QP,
-	STATE_QHALT,
-	STATE_QACCEPT, STATE_QREJECT
-};
+// Where x saves how often each rule has been used
+#define HITSFILE "hits.csv"
+// The machine library s saves to and l loads from (unless another is given)
+#define LIBRARYFILE "machines.tml"
 
 // Display characters for a state
 static const chtype state_ch[NUMSTT + 3] =
@@ -80,50 +70,18 @@ static const chtype dir_ch[2] =
 	'r'|COLOR_PAIR(8)|A_BOLD
 };
 
-// Adds a character on the Curses window
+// Drawing goes to a frame buffer the size of the window rather than straight to curses.
+// Adds a character to the frame being drawn
 void addChar(int, int, chtype);
-
-// Represents a transition for a rule in the modifiable rule-set
-// of a TM
-struct transition
-{
-    state next_state;
-    symbol write_symbol;
-    direction move_head;
-    state curr_state;
-    symbol curr_symbol;
-};
-
-// Class declarations for the TM below...
-
-class tape_head
-{
-    public:
-        tape_head();
-        void moveTapeHead();
-        void setCurrentDirection(direction);
-        void setCurrentState(state);
-        void setTapeHeadLoc(int);
-        int getTapeHeadLoc();
-        direction getCurrentDirection();
-        state getCurrentState();
-    private:
-        int loc;
-        direction curr_dir;
-        state curr_state;
-};
-
-class tape
-{
-    public:
-        tape();
-        void setupTape();
-        void setTapeCell(symbol,int);
-        symbol getTapeCell(int);
-    private:
-        // Fixed TM tape size
-        symbol values[TAPESIZE];
-};
+// Adds formatted text to the frame being drawn, with the given attributes
+void addText(int, int, chtype, const char *, ...);
+// Blanks the frame being drawn
+void clearFrame();
+// Sends the characters that changed since the last frame to the terminal
+void showFrame();
+// Forgets what the terminal shows, so that the next showFrame() sends everything
+// (after something has drawn on the window directly)
+void invalidateFrame();
 
 // Main program class below
 
@@ -132,6 +90,7 @@ class sim_obj
     public:
         sim_obj();
         void runApp();
+        void runReplay(trace_reader &);
         void reDisplay();
         void reDisplayMachine();
         void printTapeHead();
@@ -140,23 +99,41 @@ class sim_obj
         void reInitializeEverything(bool);
         void printStats();
         void simulate();
-        void applyTransition();
-        void setupTransitionTable(bool);
+        void showSnapshot(const sim_snapshot &);
+        void changeSpeed(int);
+        void editRule(int,int,const transition &);
+        void editCell(long long,symbol);
+        void moveHead(long long);
         void checkClick(MEVENT);
         void checkTransitionTableClick(int,int);
         void checkTapeCellAreaClick(int,int);
         void checkTapeHeadAreaClick(int,int);
+        bool promptNumber(const char *,long long &);
+        void saveHits();
+        void setLibrary(const std::string &);
+        void saveMachine();
+        void loadMachine();
+        void changeSize();
+        void showMessage(const char *,...);
         state getNextRuleState(int,int);
         symbol getNextRuleSymbol(int,int);
         direction getNextRuleDirection(int,int);
     private:
-        // This class contains a tape head object and tape object
-        tape_head th_obj;
-        tape tape_obj;
-        // Instance of an 2d array of rules representing A TM
-        transition ruleset[NUMSTT][NUMSYM];
-        bool halt;
-        int ticks;
+        // This class contains the (render-free) machine: tape head, tape and rule-set
+        tm_engine machine;
+        // Steps taken so far, for stepping back and seeking
+        history past;
+        // Runs the machine on its own thread while the simulation is running
+        // (machine is then only a copy of what the runner last showed)
+        sim_runner runner;
+        bool running;
+        // index into speeds
+        int speed;
+        // true to colour the transition table by how often each rule has been used
+        bool heatmap;
+        // the machine library file
+        std::string library_name;
+        // the states and symbols shown in the transition table (and used by random rules)
         int num_symbols;
         int num_states;
 };